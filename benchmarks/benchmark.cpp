@@ -0,0 +1,340 @@
+/*
+Measures the hot paths of godot-uid-fixer against the code they replaced:
+- UIDs generated and encoded per second
+- the SIMD findUIDs scanner against a per line std::string_view::find
+- syscalls per file read by readFile and by readFileBatch with io_uring,
+  counted with ptrace
+- PathMatcher::selects against the old per extension string comparison, over
+  1M paths
+Results depend on the machine, so they are printed rather than checked.
+*/
+#define main godot_uid_fixer_main
+#include "../source/main.cpp"
+#undef main
+
+#include <chrono>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+
+namespace {
+// Keeps the compiler from dropping the results of measured loops.
+volatile uint64_t sink{};
+
+// Returns the seconds function takes to run.
+template <typename Function> double measureSeconds(Function function) {
+  auto start{std::chrono::steady_clock::now()};
+  function();
+
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// The UID generator before the thread_local xoshiro256** engine.
+std::string generateRandomUIDWithMersenneTwister() {
+  const std::string character_set{"abcdefghijklmnopqrstuvwxy012345678"};
+  std::string result(13, '\0');
+
+  std::random_device random_device{};
+  std::mt19937 random_number_generator(random_device());
+  std::uniform_int_distribution<int> int_distribution(
+      0, static_cast<int>(character_set.size() - 1));
+
+  for (char &character : result) {
+    character = character_set[int_distribution(random_number_generator)];
+  }
+
+  return result;
+}
+
+void benchmarkUIDGeneration() {
+  const size_t old_count{100000};
+  const size_t count{10000000};
+  char text[MAX_UID_LENGTH]{};
+
+  double old_seconds{measureSeconds([&] {
+    for (size_t i = 0; i < old_count; i++) {
+      sink += generateRandomUIDWithMersenneTwister()[0];
+    }
+  })};
+
+  double seconds{measureSeconds([&] {
+    for (size_t i = 0; i < count; i++) {
+      sink += encodeUID(uid_generator.nextUID(), text);
+    }
+  })};
+
+  std::cout << "UID generation:\n"
+            << "  std::mt19937 per UID: " << old_count / old_seconds
+            << " UIDs/s\n"
+            << "  UIDGenerator:         " << count / seconds << " UIDs/s\n";
+}
+
+// Returns a scene with one declaration, uid_count - 1 references and nodes.
+std::string makeScene(size_t uid_count, size_t node_count) {
+  std::ostringstream scene{};
+  scene << "[gd_scene load_steps=" << uid_count << " format=3 uid=\"uid://"
+        << generateRandomUID() << "\"]\n\n";
+
+  for (size_t i = 1; i < uid_count; i++) {
+    scene << "[ext_resource type=\"Texture2D\" uid=\"uid://"
+          << generateRandomUID() << "\" path=\"res://textures/" << i
+          << ".png\" id=\"" << i << "_abcde\"]\n";
+  }
+
+  for (size_t i = 0; i < node_count; i++) {
+    scene << "\n[node name=\"Sprite" << i
+          << "\" type=\"Sprite2D\" parent=\".\"]\n"
+          << "position = Vector2(" << i << ", " << i * 2 << ")\n"
+          << "texture = ExtResource(\"1_abcde\")\n";
+  }
+
+  return scene.str();
+}
+
+// Finds UIDs line by line, as the scanner did before findUIDs.
+void findUIDsPerLine(std::string_view buffer, std::vector<UIDSpan> &spans) {
+  const std::string_view prefix{"uid://"};
+  size_t line_start{};
+
+  while (line_start < buffer.size()) {
+    size_t line_end{buffer.find('\n', line_start)};
+    line_end = line_end == std::string_view::npos ? buffer.size() : line_end;
+    std::string_view line{buffer.substr(line_start, line_end - line_start)};
+    size_t uid_position{line.find(prefix)};
+
+    if (uid_position != std::string_view::npos) {
+      uid_position += prefix.size();
+      size_t quote_position{line.find('"', uid_position)};
+
+      if (quote_position != std::string_view::npos) {
+        spans.push_back(
+            {line_start + uid_position, quote_position - uid_position});
+      }
+    }
+
+    line_start = line_end + 1;
+  }
+}
+
+void benchmarkScanner() {
+  std::string buffer{};
+
+  for (size_t i = 0; i < 100; i++) {
+    buffer += makeScene(20, 200);
+  }
+
+  const size_t repetitions{50};
+  std::vector<UIDSpan> spans{};
+  size_t simd_spans{};
+  size_t line_spans{};
+
+  double simd_seconds{measureSeconds([&] {
+    for (size_t i = 0; i < repetitions; i++) {
+      spans.clear();
+      findUIDs(buffer, spans);
+      simd_spans = spans.size();
+    }
+  })};
+
+  double line_seconds{measureSeconds([&] {
+    for (size_t i = 0; i < repetitions; i++) {
+      spans.clear();
+      findUIDsPerLine(buffer, spans);
+      line_spans = spans.size();
+    }
+  })};
+
+  double megabytes{static_cast<double>(buffer.size()) * repetitions / 1e6};
+
+  std::cout << "UID scanning of " << buffer.size() / 1000 << " kB, "
+            << simd_spans << " UIDs:\n"
+            << "  per line find: " << megabytes / line_seconds << " MB/s ("
+            << line_spans << " UIDs)\n"
+            << "  findUIDs:      " << megabytes / simd_seconds << " MB/s\n";
+}
+
+/*
+Runs function in a child process traced with ptrace and returns the number of
+syscall stops, one on entry and one on exit of each syscall, between its two
+raise(SIGSTOP) markers.
+*/
+template <typename Function> long countSyscallStops(Function function) {
+  pid_t child{fork()};
+
+  if (child == 0) {
+    ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+    // waits for the parent to set the trace options
+    raise(SIGSTOP);
+    function();
+    _exit(0);
+  }
+
+  int status{};
+  long stops{};
+  int markers{};
+  waitpid(child, &status, 0);
+  ptrace(PTRACE_SETOPTIONS, child, nullptr, PTRACE_O_TRACESYSGOOD);
+
+  while (true) {
+    ptrace(PTRACE_SYSCALL, child, nullptr, nullptr);
+
+    if (waitpid(child, &status, 0) < 0 || WIFEXITED(status) ||
+        WIFSIGNALED(status)) {
+      break;
+    }
+
+    if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+      stops += markers == 1;
+    } else if (WSTOPSIG(status) == SIGSTOP) {
+      markers++;
+    }
+  }
+
+  return stops;
+}
+
+// Returns the syscalls function makes between its markers, less their own.
+template <typename Function> long countSyscalls(Function function) {
+  static const long marker_stops{countSyscallStops([] {
+    raise(SIGSTOP);
+    raise(SIGSTOP);
+  })};
+
+  return (countSyscallStops(function) - marker_stops) / 2;
+}
+
+void benchmarkSyscalls() {
+  char directory_template[]{"/tmp/godot-uid-fixer-bench.XXXXXX"};
+
+  if (!mkdtemp(directory_template)) {
+    std::cout << "ERROR: Unable to create a temporary directory\n";
+
+    return;
+  }
+
+  const std::filesystem::path directory{directory_template};
+  const size_t file_count{256};
+  std::vector<std::filesystem::path> file_paths{};
+
+  for (size_t i = 0; i < file_count; i++) {
+    file_paths.push_back(directory / (std::to_string(i) + ".tscn"));
+    std::ofstream(file_paths.back()) << makeScene(5, 5);
+  }
+
+  auto makeJobs{[&] {
+    std::vector<std::unique_ptr<FileJob>> jobs{};
+
+    for (const std::filesystem::path &file_path : file_paths) {
+      jobs.push_back(std::make_unique<FileJob>());
+      jobs.back()->file_path = file_path;
+    }
+
+    return jobs;
+  }};
+
+  long read_syscalls{countSyscalls([&] {
+    auto jobs{makeJobs()};
+    raise(SIGSTOP);
+
+    for (std::unique_ptr<FileJob> &job : jobs) {
+      readFile(*job);
+    }
+
+    raise(SIGSTOP);
+  })};
+
+  bool ring_valid{IOUring(IO_URING_ENTRIES).isValid()};
+  long ring_syscalls{countSyscalls([&] {
+    auto jobs{makeJobs()};
+    IOUring ring(IO_URING_ENTRIES);
+    std::vector<FileJob *> batch{};
+    raise(SIGSTOP);
+
+    for (std::unique_ptr<FileJob> &job : jobs) {
+      batch.push_back(job.get());
+
+      if (batch.size() == ring.size()) {
+        readFileBatch(ring, batch);
+        batch.clear();
+      }
+    }
+
+    if (!batch.empty()) {
+      readFileBatch(ring, batch);
+    }
+
+    raise(SIGSTOP);
+  })};
+
+  std::cout << "Syscalls reading " << file_count << " files:\n"
+            << "  readFile:              "
+            << static_cast<double>(read_syscalls) / file_count
+            << " per file\n";
+
+  if (ring_valid) {
+    std::cout << "  readFileBatch io_uring: "
+              << static_cast<double>(ring_syscalls) / file_count
+              << " per file\n";
+  } else {
+    std::cout << "  readFileBatch io_uring: unavailable\n";
+  }
+
+  std::error_code error_code{};
+  std::filesystem::remove_all(directory, error_code);
+}
+
+// The extension check before PathMatcher.
+bool checkFileExtension(const std::filesystem::path &file_path) {
+  for (std::string file_extension : SUPPORTED_FILE_EXTENSIONS) {
+    if (file_path.extension().string() == file_extension) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void benchmarkPathMatcher() {
+  const char *extensions[]{".tscn", ".tres", ".gd", ".png", ".import", ".res"};
+  std::vector<std::filesystem::path> paths{};
+  paths.reserve(1000000);
+
+  for (size_t i = 0; i < 1000000; i++) {
+    paths.emplace_back("./level" + std::to_string(i % 100) + "/props/item" +
+                       std::to_string(i) + extensions[i % 6]);
+  }
+
+  PathMatcher matcher{};
+  matcher.compile({}, {});
+  size_t old_selected{};
+  size_t selected{};
+
+  double old_seconds{measureSeconds([&] {
+    for (const std::filesystem::path &path : paths) {
+      old_selected += checkFileExtension(path);
+    }
+  })};
+
+  double seconds{measureSeconds([&] {
+    for (const std::filesystem::path &path : paths) {
+      selected += matcher.selects(path);
+    }
+  })};
+
+  std::cout << "Selecting " << paths.size() / 1000000 << "M paths:\n"
+            << "  checkFileExtension:    " << old_seconds * 1000 << " ms ("
+            << old_selected << " selected)\n"
+            << "  PathMatcher::selects:  " << seconds * 1000 << " ms ("
+            << selected << " selected)\n";
+}
+} // namespace
+
+int main() {
+  benchmarkUIDGeneration();
+  benchmarkScanner();
+  benchmarkSyscalls();
+  benchmarkPathMatcher();
+
+  return 0;
+}
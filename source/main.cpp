@@ -1,10 +1,41 @@
 #include "CLI11.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <dirent.h>
+#include <fcntl.h>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #include <iostream>
+#include <linux/io_uring.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <poll.h>
 #include <random>
+#include <sstream>
+#include <set>
 #include <string>
+#include <string_view>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
 const int8_t VERSION_MAJOR{1};
@@ -14,57 +45,374 @@ const int8_t RELEASE{3};
 // Return codes
 const int8_t SUCCESS{0};
 const int8_t FILE_OPEN_FAILED{-1};
+const int8_t CHECK_FAILED{-2};
 
-const int8_t UID_LENGTH{12};
+const int8_t MAX_UID_LENGTH{13};
 const int8_t UID_OFFSET{6};
 
-const std::string CHARACTER_SET{"abcdefghijklmnopqrstuvwxyz0123456789"};
 const std::string SUPPORTED_FILE_EXTENSIONS[6]{".uid",  ".tres", ".res",
                                                ".tscn", ".scn",  ".import"};
 
 bool recursive{false};
 bool verbose{false};
+bool in_place{false};
+bool backup{false};
+bool duplicates_only{false};
+bool remap{false};
+bool use_cache{false};
+bool watching{false};
+bool check{false};
+bool undo{false};
+bool use_io_uring{false};
+bool full_scan{false};
+bool use_editor_cache{false};
+bool use_godot_uid_cache{false};
+std::vector<std::string> include_patterns{};
+std::vector<std::string> exclude_patterns{};
+unsigned jobs{1};
 
 std::vector<std::filesystem::path> file_paths{};
 
+const uint64_t INVALID_UID{~0ULL};
+const uint64_t UID_MASK{0x7fffffffffffffff};
+
+/*
+Number of digits of the text form of Godot's 64 bit UIDs. ResourceUID counts
+'z' - 'a' letters and '9' - '0' digits, so 'z' and '9' are never written.
+*/
+const uint64_t UID_BASE{34};
+
+// Number of digits written as letters, the rest are written as 0 to 8.
+const uint8_t UID_LETTER_DIGITS{'z' - 'a'};
+
+// Characters of the text form of UIDs by digit value, as in id_to_text.
+const char UID_CHARACTERS[UID_BASE + 1]{"abcdefghijklmnopqrstuvwxy012345678"};
+
+// UID_POWERS[i] is the smallest UID whose text form is i + 1 characters long.
+constexpr std::array<uint64_t, MAX_UID_LENGTH> UID_POWERS{[] {
+  std::array<uint64_t, MAX_UID_LENGTH> powers{1};
+
+  for (size_t i = 1; i < powers.size(); i++) {
+    powers[i] = powers[i - 1] * UID_BASE;
+  }
+
+  return powers;
+}()};
+
+/*
+Digit value of every byte in the text form of UIDs, or 0x80 for bytes that
+can't appear in it. Like text_to_id, 'z' is read as the same digit as '0' and
+'9' is accepted with a value of 34.
+*/
+constexpr std::array<uint8_t, 256> UID_DIGITS{[] {
+  std::array<uint8_t, 256> digits{};
+
+  for (uint8_t &digit : digits) {
+    digit = 0x80;
+  }
+
+  for (int character = 'a'; character <= 'z'; character++) {
+    digits[character] = character - 'a';
+  }
+
+  for (int character = '0'; character <= '9'; character++) {
+    digits[character] = character - '0' + UID_LETTER_DIGITS;
+  }
+
+  return digits;
+}()};
+
+// Text form of every pair of digits, so encodeUID divides once per pair.
+constexpr std::array<std::array<char, 2>, UID_BASE * UID_BASE>
+    UID_CHARACTER_PAIRS{[] {
+      std::array<std::array<char, 2>, UID_BASE * UID_BASE> pairs{};
+
+      for (size_t i = 0; i < pairs.size(); i++) {
+        pairs[i] = {UID_CHARACTERS[i / UID_BASE], UID_CHARACTERS[i % UID_BASE]};
+      }
+
+      return pairs;
+    }()};
+
+/*
+Decodes the text form of a UID without "uid://" into the 63 bit integer Godot
+uses for it, the same way as ResourceUID::text_to_id. Invalid characters are
+collected in a flag instead of branching on every character. Returns
+INVALID_UID for empty text or text with characters outside of a-z and 0-9.
+*/
+constexpr uint64_t decodeUID(std::string_view text) {
+  uint64_t uid{};
+  uint8_t invalid{text.empty() ? uint8_t{0x80} : uint8_t{0}};
+
+  for (char character : text) {
+    uint8_t digit{UID_DIGITS[static_cast<uint8_t>(character)]};
+    invalid |= digit;
+    uid = uid * UID_BASE + (digit & 0x7f);
+  }
+
+  return invalid & 0x80 ? INVALID_UID : uid & UID_MASK;
+}
+
+// UIDs whose text and integer forms were checked against ResourceUID.
+static_assert(decodeUID("dvnsk6qq5gfx3") == 8661177095797630030ULL);
+static_assert(decodeUID("8") == UID_BASE - 1 && decodeUID("ba") == UID_BASE);
+static_assert(decodeUID("z") == decodeUID("0"));
+
+// Returns the number of characters in the text form of uid.
+int encodedUIDLength(uint64_t uid) {
+  int length{1};
+
+  for (int i = 1; i < MAX_UID_LENGTH; i++) {
+    length += uid >= UID_POWERS[i];
+  }
+
+  return length;
+}
+
+/*
+Writes the text form of uid without "uid://" to output, the same way as
+ResourceUID::id_to_text, two characters at a time from UID_CHARACTER_PAIRS.
+output must hold MAX_UID_LENGTH characters. Returns the number written.
+*/
+int encodeUID(uint64_t uid, char *output) {
+  const int length{encodedUIDLength(uid)};
+  int position{length};
+
+  for (; position >= 2; position -= 2) {
+    std::memcpy(output + position - 2,
+                UID_CHARACTER_PAIRS[uid % (UID_BASE * UID_BASE)].data(), 2);
+    uid /= UID_BASE * UID_BASE;
+  }
+
+  if (position == 1) {
+    output[0] = UID_CHARACTERS[uid];
+  }
+
+  return length;
+}
+
+std::string encodeUID(uint64_t uid) {
+  char text[MAX_UID_LENGTH]{};
+
+  return std::string(text, encodeUID(uid, text));
+}
+
+/*
+Generates random UIDs from a xoshiro256** engine that is seeded once from
+std::random_device, so producing a UID costs a handful of arithmetic operations
+instead of a syscall and a full std::mt19937 state initialization.
+*/
+class UIDGenerator {
+public:
+  UIDGenerator() {
+    std::random_device random_device{};
+    uint64_t seed{(static_cast<uint64_t>(random_device()) << 32) |
+                  random_device()};
+
+    // splitmix64 expands the seed into the full engine state
+    for (uint64_t &word : state) {
+      seed += 0x9e3779b97f4a7c15;
+      uint64_t z{seed};
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+      word = z ^ (z >> 31);
+    }
+  }
+
+  // Returns a random UID in the 63 bit range Godot uses.
+  uint64_t nextUID() { return next() & UID_MASK; }
+
+  /*
+  Returns a random UID whose text form is text_length characters long, so it
+  can replace a UID of that length without moving the bytes after it. Other
+  lengths give any UID.
+  */
+  uint64_t nextUID(size_t text_length) {
+    if (text_length == 0 || text_length > MAX_UID_LENGTH) {
+      return nextUID();
+    }
+
+    uint64_t low{text_length == 1 ? 0 : UID_POWERS[text_length - 1]};
+    uint64_t high{text_length == MAX_UID_LENGTH ? UID_MASK + 1
+                                                : UID_POWERS[text_length]};
+
+    // multiply-shift maps the random value onto [low, high)
+    return low + static_cast<uint64_t>(
+                     (static_cast<unsigned __int128>(next()) * (high - low)) >>
+                     64);
+  }
+
+  uint64_t next() {
+    const uint64_t result{rotateLeft(state[1] * 5, 7) * 9};
+    const uint64_t shifted{state[1] << 17};
+
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= shifted;
+    state[3] = rotateLeft(state[3], 45);
+
+    return result;
+  }
+
+  // Writes count random UIDs to uids.
+  void generateBatch(uint64_t *uids, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+      uids[i] = nextUID();
+    }
+  }
+
+private:
+  uint64_t state[4]{};
+
+  static uint64_t rotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+  }
+};
+
+// One generator per thread, seeded on first use.
+thread_local UIDGenerator uid_generator{};
+
+// Returns the text form of a random UID from the thread's UIDGenerator.
+std::string generateRandomUID() { return encodeUID(uid_generator.nextUID()); }
+
+/*
+Maps UIDs to values with open addressing and linear probing over a power of
+two sized array of slots. Empty slots hold INVALID_UID, which is never a
+decoded UID.
+*/
+template <typename Value> class UIDTable {
+public:
+  UIDTable() : slots(16, Slot{INVALID_UID, Value{}}) {}
+
+  /*
+  Stores value for uid if uid is new and returns a pointer to the value stored
+  for uid, which stays valid until the next insert.
+  */
+  Value *insert(uint64_t uid, Value value) {
+    if ((count + 1) * 4 > slots.size() * 3) {
+      grow();
+    }
+
+    Slot &slot{probe(uid)};
+
+    if (slot.uid == INVALID_UID) {
+      slot = {uid, value};
+      count++;
+    }
+
+    return &slot.value;
+  }
+
+  const Value *find(uint64_t uid) const {
+    const Slot &slot{const_cast<UIDTable *>(this)->probe(uid)};
+
+    return slot.uid == INVALID_UID ? nullptr : &slot.value;
+  }
+
+  size_t size() const { return count; }
+
+  // Calls function with each UID and its value, in no particular order.
+  template <typename Function> void forEach(Function function) const {
+    for (const Slot &slot : slots) {
+      if (slot.uid != INVALID_UID) {
+        function(slot.uid, slot.value);
+      }
+    }
+  }
+
+private:
+  struct Slot {
+    uint64_t uid;
+    Value value;
+  };
+
+  std::vector<Slot> slots;
+  size_t count{};
+
+  // murmur3 finalizer, spreads UIDs that differ in few bits across slots
+  static uint64_t hash(uint64_t uid) {
+    uid ^= uid >> 33;
+    uid *= 0xff51afd7ed558ccd;
+    uid ^= uid >> 33;
+    uid *= 0xc4ceb9fe1a85ec53;
+    uid ^= uid >> 33;
+
+    return uid;
+  }
+
+  // Returns the slot holding uid, or the empty slot where it belongs.
+  Slot &probe(uint64_t uid) {
+    const size_t mask{slots.size() - 1};
+    size_t index{hash(uid) & mask};
+
+    while (slots[index].uid != uid && slots[index].uid != INVALID_UID) {
+      index = (index + 1) & mask;
+    }
+
+    return slots[index];
+  }
+
+  void grow() {
+    std::vector<Slot> old_slots(slots.size() * 2, Slot{INVALID_UID, Value{}});
+    old_slots.swap(slots);
+
+    for (const Slot &slot : old_slots) {
+      if (slot.uid != INVALID_UID) {
+        probe(slot.uid) = slot;
+      }
+    }
+  }
+};
+
+// Maps UIDs to the index of the file that declares them in 16 byte slots.
+using UIDIndex = UIDTable<uint32_t>;
+
 /*
-Iterates through each character in a string of UID_LENGTH size and places a
-random character in its place.
+Characters that end the text of a UID: quotes, whitespace, line ends and the
+separators and closing brackets that can follow a UID written inside an array
+or dictionary.
 */
-std::string generateRandomUID() {
-  std::string result{};
-  result.resize(UID_LENGTH);
+constexpr std::array<bool, 256> UID_TERMINATORS{[] {
+  std::array<bool, 256> terminators{};
 
-  std::random_device random_device{};
-  std::mt19937 random_number_generator(random_device());
-  std::uniform_int_distribution<int> int_distribution(
-      0, static_cast<int>(CHARACTER_SET.length() - 1));
+  for (unsigned char character : std::string_view{"\"' \t\r\n,;)]}"}) {
+    terminators[character] = true;
+  }
+
+  return terminators;
+}()};
 
-  for (int i = 0; i < UID_LENGTH; i++) {
-    result[i] = CHARACTER_SET[int_distribution(random_number_generator)];
+// Returns the position of the first character after the UID at uid_position.
+size_t findUIDEnd(std::string_view buffer, size_t uid_position) {
+  while (uid_position < buffer.size() &&
+         !UID_TERMINATORS[static_cast<unsigned char>(buffer[uid_position])]) {
+    uid_position++;
   }
 
-  return result;
+  return uid_position;
 }
 
 // Prints unable to open file error message.
-void printFileErrorMessage(const std::filesystem::path &file_path) {
-  std::cout << "ERROR: Unable to open file: " << file_path.string()
+void printFileErrorMessage(const std::filesystem::path &file_path,
+                           std::ostream &output) {
+  output << "ERROR: Unable to open file: " << file_path.string()
             << "(Maybe invalid read/write permissions?)\n";
 }
 
 /*
 Iterates through each line in a file and writes each line to a temporary
-file, then removes the old file and renames temporary file to the
-name of the old file. If a UID is found within a line, replaces it with a new
-UID using generateRandomUID then writes the line.
+file, then renames the temporary file over the old file. If a UID is found
+within a line, replaces it with a new UID using generateRandomUID then writes
+the line. Only used for files that can't be memory mapped.
 */
-bool handleFile(const std::filesystem::path &file_path) {
-  std::cout << "File: " << file_path.string() << '\n';
+bool handleFileStream(const std::filesystem::path &file_path,
+                      std::ostream &output) {
   std::ifstream input_file_stream(file_path);
 
   if (!input_file_stream.is_open()) {
-    printFileErrorMessage(file_path);
+    printFileErrorMessage(file_path, output);
 
     return false;
   }
@@ -73,7 +421,7 @@ bool handleFile(const std::filesystem::path &file_path) {
   std::ofstream output_file_stream(tempfile_path);
 
   if (!output_file_stream.is_open()) {
-    printFileErrorMessage(file_path);
+    printFileErrorMessage(file_path, output);
 
     return false;
   }
@@ -90,139 +438,4275 @@ bool handleFile(const std::filesystem::path &file_path) {
       continue;
     }
 
-    // start of actual UID
-    uid_position += UID_OFFSET;
+    if (verbose) {
+      output << "Replacing line: " << line << '\n';
+    }
+
+    while (uid_position != std::string::npos) {
+      // start of actual UID
+      uid_position += UID_OFFSET;
 
-    // end of actual UID
-    size_t endquote_position{line.find('"', uid_position)};
+      // end of actual UID
+      size_t uid_end{findUIDEnd(line, uid_position)};
 
-    std::string new_uid{generateRandomUID()};
+      std::string new_uid{generateRandomUID()};
 
-    if (verbose) {
-      std::cout << "Replacing line: " << line << '\n';
-      std::cout << "[UID: " << line.substr(uid_position, UID_LENGTH)
-                << " | New UID: " << new_uid << "]\n";
-    }
+      if (verbose) {
+        output << "[UID: " << line.substr(uid_position, uid_end - uid_position)
+               << " | New UID: " << new_uid << "]\n";
+      }
 
-    // replace as many characters as the actual UID
-    line.replace(uid_position, endquote_position - uid_position, new_uid);
+      // replace as many characters as the actual UID
+      line.replace(uid_position, uid_end - uid_position, new_uid);
+      uid_position = line.find("uid://", uid_position + new_uid.size());
+    }
 
     output_file_stream << line << '\n';
     line_count++;
   }
 
-  std::cout << "Wrote " << line_count << " line(s).\n";
+  output << "Wrote " << line_count << " line(s).\n";
 
   input_file_stream.close();
   output_file_stream.close();
 
-  std::remove(file_path.c_str());
-  std::rename(tempfile_path.c_str(), file_path.c_str());
+  if (std::rename(tempfile_path.c_str(), file_path.c_str()) != 0) {
+    std::remove(tempfile_path.c_str());
+    printFileErrorMessage(file_path, output);
+
+    return false;
+  }
 
   return true;
 }
 
 /*
-Checks if the file extension is valid.
+Maps a regular file read-only for the lifetime of the object and unless
+populate is false reads all of its pages in. Empty files are not mapped and
+have a null data pointer. Files read by readFileBatch are held in a buffer
+instead.
 */
-bool checkFileExtension(const std::filesystem::path &file_path) {
-  for (std::string file_extension : SUPPORTED_FILE_EXTENSIONS) {
-    if (file_path.extension().string() == file_extension) {
-      return true;
+class MappedFile {
+public:
+  MappedFile(int file_descriptor, size_t file_size, bool populate = true)
+      : size{file_size} {
+    if (size == 0) {
+      return;
+    }
+
+    void *address{mmap(nullptr, size, PROT_READ,
+                       MAP_PRIVATE | (populate ? MAP_POPULATE : 0),
+                       file_descriptor, 0)};
+
+    if (address != MAP_FAILED) {
+      data = static_cast<const char *>(address);
+      mapped = true;
+
+      if (populate) {
+        madvise(address, size, MADV_SEQUENTIAL);
+      }
     }
   }
 
-  return false;
-}
+  explicit MappedFile(std::string file_contents)
+      : contents{std::move(file_contents)} {
+    data = contents.data();
+    size = contents.size();
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  ~MappedFile() {
+    if (mapped) {
+      munmap(const_cast<char *>(data), size);
+    }
+  }
+
+  bool isValid() const { return data || size == 0; }
+
+  std::string_view view() const { return {data, data ? size : 0}; }
+
+private:
+  std::string contents{};
+  const char *data{};
+  size_t size{};
+  bool mapped{false};
+};
 
 /*
-Checks if entry is a file and calls checkFileExtension to validate its
-extension. If both are true adds to file_paths vector.
+A minimal io_uring instance set up with raw system calls, so liburing isn't
+needed. Operations are queued with getSubmission and handed to the kernel
+together by submitAndWait, then collected with popCompletion. isValid is false
+where the kernel or a seccomp filter doesn't allow io_uring.
 */
-void handleDirectoryEntry(const std::filesystem::directory_entry &entry) {
-  if (!entry.is_regular_file()) {
-    return;
+class IOUring {
+public:
+  explicit IOUring(unsigned entries) {
+    io_uring_params params{};
+    descriptor =
+        static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+
+    if (descriptor < 0) {
+      return;
+    }
+
+    submission_ring_size =
+        params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    completion_ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    submissions_size = params.sq_entries * sizeof(io_uring_sqe);
+
+    // both rings share one mapping on all but the oldest kernels
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      submission_ring_size =
+          std::max(submission_ring_size, completion_ring_size);
+    }
+
+    submission_ring = mapRing(submission_ring_size, IORING_OFF_SQ_RING);
+    completion_ring = params.features & IORING_FEAT_SINGLE_MMAP
+                          ? submission_ring
+                          : mapRing(completion_ring_size, IORING_OFF_CQ_RING);
+    submissions = static_cast<io_uring_sqe *>(
+        mapRing(submissions_size, IORING_OFF_SQES));
+
+    if (!submission_ring || !completion_ring || !submissions) {
+      release();
+
+      return;
+    }
+
+    char *sq{static_cast<char *>(submission_ring)};
+    char *cq{static_cast<char *>(completion_ring)};
+    submission_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    submission_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    submission_mask =
+        *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    submission_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    completion_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    completion_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    completion_mask =
+        *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    completions = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    capacity = params.sq_entries;
+    local_tail = *submission_tail;
+    popped = *submission_head;
   }
 
-  if (checkFileExtension(entry.path())) {
-    file_paths.push_back(entry.path());
+  IOUring(const IOUring &) = delete;
+  IOUring &operator=(const IOUring &) = delete;
+
+  ~IOUring() { release(); }
+
+  bool isValid() const { return descriptor >= 0; }
+
+  // Number of operations that can be queued before calling submitAndWait.
+  unsigned size() const { return capacity; }
+
+  // Returns a cleared submission queue entry, queued by the next submitAndWait.
+  io_uring_sqe *getSubmission() {
+    unsigned index{local_tail++ & submission_mask};
+    submission_array[index] = index;
+    io_uring_sqe *submission{&submissions[index]};
+    std::memset(submission, 0, sizeof(io_uring_sqe));
+
+    return submission;
   }
-}
 
-void printRandomizingMessage(bool files = false) {
-  if (files) {
-    std::cout << "Randomizing UIDS of all godot file(s) listed";
-  } else {
-    std::cout << "Randomizing UIDS of all godot files in current directory";
+  /*
+  Submits all queued operations and waits until wait_count have completed. If
+  io_uring_enter fails, the operations the kernel hasn't taken are dropped and
+  the ones it has are waited for, so none is left writing to the caller's
+  buffers, and false is returned. Their completions can still be popped.
+  */
+  bool submitAndWait(unsigned wait_count) {
+    unsigned queued{local_tail - *submission_tail};
+    __atomic_store_n(submission_tail, local_tail, __ATOMIC_RELEASE);
 
-    if (recursive) {
-      std::cout << " and all subdirectories";
+    while (queued > 0 || wait_count > 0) {
+      long result{syscall(__NR_io_uring_enter, descriptor, queued, wait_count,
+                          IORING_ENTER_GETEVENTS, nullptr, 0)};
+
+      if (result < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+
+        // without SQPOLL the kernel only takes submissions in io_uring_enter
+        local_tail = __atomic_load_n(submission_head, __ATOMIC_ACQUIRE);
+        __atomic_store_n(submission_tail, local_tail, __ATOMIC_RELEASE);
+        waitForTaken();
+
+        return false;
+      }
+
+      queued -= std::min<unsigned>(queued, result);
+      unsigned completed{__atomic_load_n(completion_tail, __ATOMIC_ACQUIRE) -
+                         *completion_head};
+
+      if (completed >= wait_count) {
+        wait_count = 0;
+      }
     }
+
+    return true;
   }
 
-  std::cout << "...\n";
-}
+  // Moves the oldest completion to completion, false if there is none.
+  bool popCompletion(io_uring_cqe &completion) {
+    unsigned head{*completion_head};
+
+    if (head == __atomic_load_n(completion_tail, __ATOMIC_ACQUIRE)) {
+      return false;
+    }
+
+    completion = completions[head & completion_mask];
+    __atomic_store_n(completion_head, head + 1, __ATOMIC_RELEASE);
+    popped++;
+
+    return true;
+  }
+
+private:
+  int descriptor{-1};
+  void *submission_ring{};
+  void *completion_ring{};
+  io_uring_sqe *submissions{};
+  size_t submission_ring_size{};
+  size_t completion_ring_size{};
+  size_t submissions_size{};
+  unsigned *submission_head{};
+  unsigned *submission_tail{};
+  unsigned *submission_array{};
+  unsigned submission_mask{};
+  unsigned *completion_head{};
+  unsigned *completion_tail{};
+  unsigned completion_mask{};
+  io_uring_cqe *completions{};
+  unsigned capacity{};
+  unsigned local_tail{};
+  // completions popped, counted from the submission head at setup
+  unsigned popped{};
+
+  /*
+  Waits until every operation the kernel has taken has completed. Completions
+  are posted even while io_uring_enter refuses to wait, so a failing call is
+  retried after a short sleep.
+  */
+  void waitForTaken() {
+    while (true) {
+      unsigned taken{__atomic_load_n(submission_head, __ATOMIC_ACQUIRE) -
+                     popped};
+      unsigned completed{__atomic_load_n(completion_tail, __ATOMIC_ACQUIRE) -
+                         *completion_head};
+
+      if (completed >= taken) {
+        return;
+      }
+
+      if (syscall(__NR_io_uring_enter, descriptor, 0, taken - completed,
+                  IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+          errno != EINTR) {
+        usleep(1000);
+      }
+    }
+  }
+
+  void *mapRing(size_t size, off_t offset) {
+    void *address{mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, descriptor, offset)};
+
+    return address == MAP_FAILED ? nullptr : address;
+  }
+
+  void release() {
+    if (submissions) {
+      munmap(submissions, submissions_size);
+    }
+
+    if (completion_ring && completion_ring != submission_ring) {
+      munmap(completion_ring, completion_ring_size);
+    }
+
+    if (submission_ring) {
+      munmap(submission_ring, submission_ring_size);
+    }
+
+    if (descriptor >= 0) {
+      close(descriptor);
+    }
+
+    descriptor = -1;
+    submissions = nullptr;
+    completion_ring = submission_ring = nullptr;
+  }
+};
+
+// Byte range of a UID within a file buffer, not including "uid://".
+struct UIDSpan {
+  size_t offset;
+  size_t length;
+  // true for the UID a file declares for itself rather than a reference
+  bool declaration;
+};
+
+const std::string_view UID_PREFIX{"uid://"};
 
 /*
-Iterates through a directory and if recursive iteration is enabled, its
-subdirectories.
+Returns the position of the first "uid://" in data at or after from, or size
+if there is none. The vectorized versions compare the first and last character
+of the prefix at every position of a block at once and only verify the
+characters in between for candidate positions, the scalar version is used for
+the tail of the buffer and on CPUs without SSE2.
 */
-void randomizeDirectory() {
-  printRandomizingMessage();
+using UIDPrefixFinder = size_t (*)(const char *data, size_t size, size_t from);
+
+size_t findUIDPrefixScalar(const char *data, size_t size, size_t from) {
+  size_t position{std::string_view(data, size).find(UID_PREFIX, from)};
+
+  return position == std::string_view::npos ? size : position;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2"))) size_t
+findUIDPrefixSSE2(const char *data, size_t size, size_t from) {
+  const size_t last_offset{UID_PREFIX.size() - 1};
+  const __m128i first{_mm_set1_epi8(UID_PREFIX.front())};
+  const __m128i last{_mm_set1_epi8(UID_PREFIX.back())};
+  size_t position{from};
+
+  for (; position + last_offset + 16 <= size; position += 16) {
+    const __m128i block_first{_mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(data + position))};
+    const __m128i block_last{_mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(data + position + last_offset))};
+    unsigned mask{static_cast<unsigned>(
+        _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first),
+                                        _mm_cmpeq_epi8(block_last, last))))};
+
+    while (mask != 0) {
+      size_t candidate{position + __builtin_ctz(mask)};
 
-  if (recursive) {
-    std::filesystem::recursive_directory_iterator directory_iterator(".");
+      if (std::memcmp(data + candidate + 1, UID_PREFIX.data() + 1,
+                      last_offset - 1) == 0) {
+        return candidate;
+      }
 
-    for (const std::filesystem::directory_entry &entry : directory_iterator) {
-      handleDirectoryEntry(entry);
+      mask &= mask - 1;
     }
-  } else {
-    std::filesystem::directory_iterator directory_iterator(".");
+  }
+
+  return findUIDPrefixScalar(data, size, position);
+}
+
+__attribute__((target("avx2"))) size_t
+findUIDPrefixAVX2(const char *data, size_t size, size_t from) {
+  const size_t last_offset{UID_PREFIX.size() - 1};
+  const __m256i first{_mm256_set1_epi8(UID_PREFIX.front())};
+  const __m256i last{_mm256_set1_epi8(UID_PREFIX.back())};
+  size_t position{from};
+
+  for (; position + last_offset + 32 <= size; position += 32) {
+    const __m256i block_first{_mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(data + position))};
+    const __m256i block_last{_mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(data + position + last_offset))};
+    unsigned mask{static_cast<unsigned>(_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first),
+                         _mm256_cmpeq_epi8(block_last, last))))};
+
+    while (mask != 0) {
+      size_t candidate{position + __builtin_ctz(mask)};
+
+      if (std::memcmp(data + candidate + 1, UID_PREFIX.data() + 1,
+                      last_offset - 1) == 0) {
+        return candidate;
+      }
 
-    for (const std::filesystem::directory_entry &entry : directory_iterator) {
-      handleDirectoryEntry(entry);
+      mask &= mask - 1;
     }
   }
+
+  return findUIDPrefixSSE2(data, size, position);
+}
+#endif
+
+// Picks the widest UIDPrefixFinder the CPU supports.
+UIDPrefixFinder selectUIDPrefixFinder() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2")) {
+    return findUIDPrefixAVX2;
+  }
+
+  if (__builtin_cpu_supports("sse2")) {
+    return findUIDPrefixSSE2;
+  }
+#endif
+
+  return findUIDPrefixScalar;
 }
 
+const UIDPrefixFinder find_uid_prefix{selectUIDPrefixFinder()};
+
+// Lines on which a UID declares the UID of the file's own resource.
+const std::string_view DECLARATION_LINE_PREFIXES[4]{"[gd_scene", "[gd_resource",
+                                                    "uid=", "uid://"};
+
 /*
-Iterates through each file in file_paths and calls handleFile for each one.
-If directory iteration is enabled first calls randomizeDirectory.
+Checks if the line starting at line_start is a scene or resource header, the
+uid key of an .import file or the content of a .uid file.
 */
-bool randomize(bool directory = true) {
-  if (directory) {
-    randomizeDirectory();
-  } else {
-    printRandomizingMessage(true);
+bool isDeclarationLine(std::string_view buffer, size_t line_start) {
+  for (std::string_view prefix : DECLARATION_LINE_PREFIXES) {
+    if (buffer.compare(line_start, prefix.size(), prefix) == 0) {
+      return true;
+    }
   }
 
-  for (const std::filesystem::path &file_path : file_paths) {
-    if (!checkFileExtension(file_path)) {
-      continue;
+  return false;
+}
+
+/*
+Walks buffer once with find_uid_prefix and appends the span of every UID
+following a "uid://" to spans, including several on one line. A UID ends at
+the first character in UID_TERMINATORS. Only the first UID on a declaration
+line is a declaration, the rest are references.
+*/
+void findUIDs(std::string_view buffer, std::vector<UIDSpan> &spans) {
+  const char *data{buffer.data()};
+  const size_t size{buffer.size()};
+  size_t search_start{};
+  size_t line_start{};
+  bool first_on_line{true};
+  size_t position{find_uid_prefix(data, size, 0)};
+
+  while (position < size) {
+    size_t uid_position{position + UID_OFFSET};
+    size_t uid_end{findUIDEnd(buffer, uid_position)};
+
+    // only the text since the previous UID can hold the start of a new line
+    const void *line_start_newline{
+        memrchr(data + search_start, '\n', position - search_start)};
+
+    if (line_start_newline) {
+      line_start = static_cast<const char *>(line_start_newline) - data + 1;
+      first_on_line = true;
     }
 
-    if (!handleFile(file_path)) {
-      return false;
+    spans.push_back({uid_position, uid_end - uid_position,
+                     first_on_line && isDeclarationLine(buffer, line_start)});
+
+    first_on_line = false;
+    search_start = uid_end;
+    position = find_uid_prefix(data, size, uid_end);
+  }
+}
+
+// Text scenes and resources, which declare and reference UIDs in their header.
+const std::string TEXT_RESOURCE_EXTENSIONS[2]{".tscn", ".tres"};
+
+// Bytes of an indexed text resource that readFileBatch reads for its header.
+const size_t HEADER_READ_SIZE{64 * 1024};
+
+// Tags of the sections following the header of a text scene or resource.
+const std::string_view BODY_SECTION_TAGS[3]{"[sub_resource", "[node",
+                                            "[resource"};
+
+// Checks if the file extension is one of the text resource extensions.
+bool isTextResourcePath(const std::filesystem::path &file_path) {
+  for (const std::string &file_extension : TEXT_RESOURCE_EXTENSIONS) {
+    if (file_path.extension() == file_extension) {
+      return true;
     }
   }
 
-  return true;
+  return false;
 }
 
-int main(int argc, char **argv) {
-  CLI::App app("Randomizes UIDs of godot resources.");
+/*
+Returns the offset of the first line of buffer starting a section in
+BODY_SECTION_TAGS, or the size of buffer if there is none. Only the lines
+before it are read, so the body of a large scene is never touched.
+*/
+size_t findHeaderEnd(std::string_view buffer) {
+  const char *data{buffer.data()};
+  size_t line_start{};
 
-  app.add_option("-f, --file", file_paths, "Randomize the specified file(s)")
-      ->check(CLI::ExistingFile);
+  while (line_start < buffer.size()) {
+    if (data[line_start] == '[') {
+      for (std::string_view tag : BODY_SECTION_TAGS) {
+        if (buffer.compare(line_start, tag.size(), tag) == 0) {
+          return line_start;
+        }
+      }
+    }
 
-  app.add_flag("-r, --recursive", recursive, "Recursively randomize");
-  app.add_flag("-v, --verbose", verbose, "Verbosely randomize");
+    const void *newline{
+        std::memchr(data + line_start, '\n', buffer.size() - line_start)};
 
-  argv = app.ensure_utf8(argv);
-  CLI11_PARSE(app, argc, argv);
+    if (!newline) {
+      break;
+    }
 
-  std::cout << "godot-uid-fixer v" << VERSION_MAJOR << "." << VERSION_MINOR
-            << "-" << RELEASE << "\n\n";
+    line_start = static_cast<const char *>(newline) - data + 1;
+  }
+
+  return buffer.size();
+}
+
+/*
+Decodes the UIDs of count spans of buffer into uids. The vectorized version
+maps 16 characters to digit values at once and combines them with two
+multiply-add steps into four base 34^4 values, spans that are too long or too
+close to the start of the buffer for a 16 byte load ending at the UID are
+decoded with decodeUID.
+*/
+using UIDBatchDecoder = void (*)(std::string_view buffer, const UIDSpan *spans,
+                                 size_t count, uint64_t *uids);
+
+void decodeUIDBatchScalar(std::string_view buffer, const UIDSpan *spans,
+                          size_t count, uint64_t *uids) {
+  for (size_t i = 0; i < count; i++) {
+    uids[i] = decodeUID(buffer.substr(spans[i].offset, spans[i].length));
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("ssse3"))) void
+decodeUIDBatchSSSE3(std::string_view buffer, const UIDSpan *spans,
+                    size_t count, uint64_t *uids) {
+  const __m128i positions{
+      _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)};
+  const __m128i pair_weights{_mm_setr_epi8(34, 1, 34, 1, 34, 1, 34, 1, 34, 1,
+                                           34, 1, 34, 1, 34, 1)};
+  const __m128i quad_weights{
+      _mm_setr_epi16(34 * 34, 1, 34 * 34, 1, 34 * 34, 1, 34 * 34, 1)};
+  const uint64_t quad_base{UID_POWERS[4]};
+
+  for (size_t i = 0; i < count; i++) {
+    const UIDSpan &span{spans[i]};
+    const size_t end{span.offset + span.length};
+
+    if (span.length == 0 || span.length > 16 || end < 16) {
+      uids[i] = decodeUID(buffer.substr(span.offset, span.length));
+
+      continue;
+    }
+
+    // the UID is right aligned in the block, earlier bytes are masked out
+    const __m128i characters{_mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(buffer.data() + end - 16))};
+    const __m128i used{_mm_cmpgt_epi8(
+        positions, _mm_set1_epi8(static_cast<char>(15 - span.length)))};
+
+    const __m128i is_lower{
+        _mm_and_si128(_mm_cmpgt_epi8(characters, _mm_set1_epi8('a' - 1)),
+                      _mm_cmplt_epi8(characters, _mm_set1_epi8('z' + 1)))};
+    const __m128i is_digit{
+        _mm_and_si128(_mm_cmpgt_epi8(characters, _mm_set1_epi8('0' - 1)),
+                      _mm_cmplt_epi8(characters, _mm_set1_epi8('9' + 1)))};
+    const __m128i unused{_mm_andnot_si128(used, _mm_set1_epi8(-1))};
+    const __m128i valid{
+        _mm_or_si128(_mm_or_si128(is_lower, is_digit), unused)};
+
+    if (_mm_movemask_epi8(valid) != 0xffff) {
+      uids[i] = INVALID_UID;
+
+      continue;
+    }
+
+    __m128i digits{_mm_or_si128(
+        _mm_and_si128(is_lower,
+                      _mm_sub_epi8(characters, _mm_set1_epi8('a'))),
+        _mm_and_si128(is_digit,
+                      _mm_sub_epi8(characters,
+                                   _mm_set1_epi8('0' - UID_LETTER_DIGITS))))};
+    digits = _mm_and_si128(digits, used);
+
+    const __m128i quads{_mm_madd_epi16(
+        _mm_maddubs_epi16(digits, pair_weights), quad_weights)};
+    alignas(16) uint32_t values[4]{};
+    _mm_store_si128(reinterpret_cast<__m128i *>(values), quads);
+
+    uids[i] = (((values[0] * quad_base + values[1]) * quad_base + values[2]) *
+                   quad_base +
+               values[3]) &
+              UID_MASK;
+  }
+}
+#endif
+
+// Picks the widest UIDBatchDecoder the CPU supports.
+UIDBatchDecoder selectUIDBatchDecoder() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("ssse3")) {
+    return decodeUIDBatchSSSE3;
+  }
+#endif
+
+  return decodeUIDBatchScalar;
+}
+
+const UIDBatchDecoder decode_uid_batch{selectUIDBatchDecoder()};
+
+/*
+Writes all of iovecs to file_descriptor, resubmitting after partial writes and
+splitting the list into IOV_MAX sized chunks.
+*/
+bool writeVectors(int file_descriptor, std::vector<iovec> &iovecs) {
+  size_t index{};
+
+  while (index < iovecs.size()) {
+    int count{
+        static_cast<int>(std::min<size_t>(iovecs.size() - index, IOV_MAX))};
+    ssize_t written{writev(file_descriptor, &iovecs[index], count)};
+
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return false;
+    }
+
+    // skip over fully written vectors and advance into a partial one
+    while (index < iovecs.size() &&
+           static_cast<size_t>(written) >= iovecs[index].iov_len) {
+      written -= iovecs[index].iov_len;
+      index++;
+    }
+
+    if (written > 0) {
+      iovecs[index].iov_base =
+          static_cast<char *>(iovecs[index].iov_base) + written;
+      iovecs[index].iov_len -= written;
+    }
+  }
+
+  return true;
+}
+
+// Returns the line of buffer containing position, without its line ending.
+std::string_view lineAt(std::string_view buffer, size_t position) {
+  size_t line_start{buffer.rfind('\n', position)};
+  line_start = line_start == std::string_view::npos ? 0 : line_start + 1;
+
+  size_t line_end{buffer.find('\n', position)};
+
+  if (line_end == std::string_view::npos) {
+    line_end = buffer.size();
+  }
+
+  return buffer.substr(line_start, line_end - line_start);
+}
+
+/*
+Text forms of new UIDs, each stored in a MAX_UID_LENGTH wide slot of one
+string so writev and pwrite can point straight into it. assign reuses the
+storage of earlier calls, so a long-lived instance stops allocating once it
+has held the largest file's UIDs.
+*/
+class EncodedUIDs {
+public:
+  void assign(const std::vector<uint64_t> &uids) {
+    text.resize(uids.size() * MAX_UID_LENGTH);
+    lengths.resize(uids.size());
+
+    for (size_t i = 0; i < uids.size(); i++) {
+      lengths[i] = encodeUID(uids[i], text.data() + i * MAX_UID_LENGTH);
+    }
+  }
+
+  std::string_view operator[](size_t index) const {
+    return {text.data() + index * MAX_UID_LENGTH, lengths[index]};
+  }
+
+private:
+  std::string text;
+  std::vector<uint8_t> lengths;
+};
+
+// Returns the directory containing file_path, "." for relative file names.
+std::filesystem::path parentDirectory(const std::filesystem::path &file_path) {
+  std::filesystem::path directory{file_path.parent_path()};
+
+  return directory.empty() ? "." : directory;
+}
+
+// Returns the name a replacement of file_path is staged under, <name>.tmp.
+std::filesystem::path tempfilePath(const std::filesystem::path &file_path) {
+  return file_path.string() + ".tmp";
+}
+
+/*
+Opens an unnamed temporary file with O_TMPFILE in the directory of file_path,
+so nothing is left behind if the process dies before stageFile links it. On
+file systems without O_TMPFILE a <name>.tmp file is created instead and its
+path stored in tempfile_path. The file gets the permissions in file_mode
+regardless of the umask.
+*/
+int openTempfile(const std::filesystem::path &file_path, mode_t file_mode,
+                 std::filesystem::path &tempfile_path) {
+  int descriptor{open(parentDirectory(file_path).c_str(),
+                      O_TMPFILE | O_WRONLY | O_CLOEXEC, file_mode & 07777)};
+
+  if (descriptor < 0 &&
+      (errno == EOPNOTSUPP || errno == EISDIR || errno == EINVAL)) {
+    // O_EXCL leaves a <name>.tmp this run didn't create alone
+    descriptor = open(tempfilePath(file_path).c_str(),
+                      O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                      file_mode & 07777);
+
+    if (descriptor >= 0) {
+      tempfile_path = tempfilePath(file_path);
+    }
+  }
+
+  if (descriptor >= 0 && fchmod(descriptor, file_mode & 07777) != 0) {
+    close(descriptor);
+    descriptor = -1;
+
+    if (!tempfile_path.empty()) {
+      std::remove(tempfile_path.c_str());
+      tempfile_path.clear();
+    }
+  }
+
+  return descriptor;
+}
+
+/*
+Syncs the data of a temporary file from openTempfile once written says all of
+it was written and stores its descriptor in tempfile_descriptor for stageFile,
+so an incomplete file is never renamed over the original. Otherwise the
+temporary file is closed and removed.
+*/
+bool keepTempfile(const std::filesystem::path &file_path, int descriptor,
+                  bool written, int &tempfile_descriptor,
+                  std::filesystem::path &tempfile_path, std::ostream &output) {
+  if (!written || fdatasync(descriptor) != 0) {
+    close(descriptor);
+
+    if (!tempfile_path.empty()) {
+      std::remove(tempfile_path.c_str());
+      tempfile_path.clear();
+    }
+
+    printFileErrorMessage(file_path, output);
+
+    return false;
+  }
+
+  tempfile_descriptor = descriptor;
+
+  return true;
+}
+
+/*
+Writes the unchanged spans of buffer between UIDs and the new UIDs to a
+temporary file from openTempfile with writev and keeps it with keepTempfile.
+The vector list is kept per thread and reused.
+*/
+bool rewriteFile(const std::filesystem::path &file_path, mode_t file_mode,
+                 std::string_view buffer, const std::vector<UIDSpan> &spans,
+                 const EncodedUIDs &new_uids, int &tempfile_descriptor,
+                 std::filesystem::path &tempfile_path,
+                 std::ostream &output) {
+  static thread_local std::vector<iovec> iovecs{};
+  iovecs.clear();
+  size_t copied_until{};
+
+  for (size_t i = 0; i < spans.size(); i++) {
+    iovecs.push_back({const_cast<char *>(buffer.data()) + copied_until,
+                      spans[i].offset - copied_until});
+    iovecs.push_back(
+        {const_cast<char *>(new_uids[i].data()), new_uids[i].size()});
+    copied_until = spans[i].offset + spans[i].length;
+  }
+
+  iovecs.push_back({const_cast<char *>(buffer.data()) + copied_until,
+                    buffer.size() - copied_until});
+
+  int output_descriptor{openTempfile(file_path, file_mode, tempfile_path)};
+
+  if (output_descriptor < 0) {
+    printFileErrorMessage(file_path, output);
+
+    return false;
+  }
+
+  if (!keepTempfile(file_path, output_descriptor,
+                    writeVectors(output_descriptor, iovecs),
+                    tempfile_descriptor, tempfile_path, output)) {
+    return false;
+  }
+
+  output << "Wrote " << spans.size() << " UID(s).\n";
+
+  return true;
+}
+
+// Most bytes a patch replaces, the text form of a UID or a binary UID field.
+const size_t MAX_PATCH_LENGTH{16};
+
+/*
+Bytes to write over a file at offset, along with the bytes that were there
+before, so the patch can be undone.
+*/
+struct FilePatch {
+  uint64_t offset;
+  uint8_t length;
+  char old_bytes[MAX_PATCH_LENGTH];
+  char new_bytes[MAX_PATCH_LENGTH];
+};
+
+// Copies the file at file_path to <name>.bak if backup is enabled.
+bool backupFile(const std::filesystem::path &file_path, std::ostream &output) {
+  if (!backup) {
+    return true;
+  }
+
+  std::error_code error_code{};
+  std::filesystem::copy_file(file_path, file_path.string() + ".bak",
+                             std::filesystem::copy_options::overwrite_existing,
+                             error_code);
+
+  if (error_code) {
+    printFileErrorMessage(file_path, output);
+
+    return false;
+  }
+
+  return true;
+}
+
+/*
+Collects a patch of the bytes of each UID in spans to patches, to be written
+with pwrite by applyPatches once the run commits, so only the UIDs are written
+rather than the whole file.
+*/
+bool patchFileInPlace(const std::filesystem::path &file_path,
+                      std::string_view buffer,
+                      const std::vector<UIDSpan> &spans,
+                      const EncodedUIDs &new_uids,
+                      std::vector<FilePatch> &patches, std::ostream &output) {
+  if (!backupFile(file_path, output)) {
+    return false;
+  }
+
+  patches.resize(spans.size());
+
+  for (size_t i = 0; i < spans.size(); i++) {
+    FilePatch &patch{patches[i]};
+    patch.offset = spans[i].offset;
+    patch.length = static_cast<uint8_t>(spans[i].length);
+    std::memcpy(patch.old_bytes, buffer.data() + spans[i].offset,
+                patch.length);
+    std::memcpy(patch.new_bytes, new_uids[i].data(), patch.length);
+  }
+
+  output << "Patched " << spans.size() << " UID(s) in place.\n";
+
+  return true;
+}
+
+/*
+Writes the new bytes of each patch to the file at file_path with pwrite, or
+the old bytes if undo is set, then syncs the file's data.
+*/
+bool applyPatches(const std::filesystem::path &file_path,
+                  const std::vector<FilePatch> &patches, bool undo = false) {
+  int descriptor{open(file_path.c_str(), O_WRONLY | O_CLOEXEC)};
+
+  if (descriptor < 0) {
+    return false;
+  }
+
+  bool written{true};
+
+  for (size_t i = 0; i < patches.size() && written; i++) {
+    const FilePatch &patch{patches[i]};
+    written = pwrite(descriptor, undo ? patch.old_bytes : patch.new_bytes,
+                     patch.length, patch.offset) == patch.length;
+  }
+
+  written = written && fdatasync(descriptor) == 0;
+
+  return close(descriptor) == 0 && written;
+}
+
+// A UID declared by a file other than the one that owns it.
+struct DuplicateUID {
+  uint64_t uid;
+  uint32_t file_index;
+};
+
+/*
+The files that declare UIDs and the index of which file owns each UID. When
+several files declare the same UID the one with the lowest path keeps it and
+the others are listed in duplicates along with the UID they share.
+*/
+struct ProjectIndex {
+  UIDIndex uid_index{};
+  std::vector<std::filesystem::path> declaring_files{};
+  std::vector<DuplicateUID> duplicates{};
+
+  // replacement of each declared UID, filled for REMAP
+  UIDTable<uint64_t> remapped_uids{};
+
+  // UIDs declared by each of declaring_files, only kept if keep_file_uids
+  bool keep_file_uids{false};
+  std::vector<std::vector<uint64_t>> file_uids{};
+};
+
+const std::string BINARY_RESOURCE_EXTENSIONS[2]{".res", ".scn"};
+
+// Flag in the header of a binary resource that marks it as storing UIDs.
+const uint32_t BINARY_FORMAT_FLAG_UIDS{2};
+const uint32_t BINARY_FORMAT_FLAG_HAS_SCRIPT_CLASS{8};
+const int BINARY_RESERVED_FIELDS{11};
+
+// Offset and value of an 8 byte UID field in a binary resource.
+struct BinaryUIDField {
+  uint64_t offset;
+  uint64_t uid;
+  bool declaration;
+};
+
+/*
+Reads the integers and strings of a binary resource header through a small
+buffer filled with pread, so only the blocks holding the header, the string
+table and the external resource table are read. Any read past the end of the
+file clears ok.
+*/
+class BinaryResourceReader {
+public:
+  explicit BinaryResourceReader(int file_descriptor)
+      : descriptor{file_descriptor} {}
+
+  bool ok{true};
+  bool big_endian{false};
+
+  uint64_t tell() const { return position; }
+
+  void skip(uint64_t bytes) { position += bytes; }
+
+  uint32_t read32() {
+    uint32_t value{};
+    read(&value, sizeof(value));
+
+    return big_endian ? __builtin_bswap32(value) : value;
+  }
+
+  uint64_t read64() {
+    uint64_t value{};
+    read(&value, sizeof(value));
+
+    return big_endian ? __builtin_bswap64(value) : value;
+  }
+
+  // Skips a length prefixed string.
+  void skipString() { skip(read32()); }
+
+  void read(void *destination, size_t bytes) {
+    if (position < buffer_start ||
+        position + bytes > buffer_start + buffer_length) {
+      ssize_t length{pread(descriptor, buffer, sizeof(buffer), position)};
+      buffer_start = position;
+      buffer_length = length < 0 ? 0 : length;
+    }
+
+    if (position + bytes > buffer_start + buffer_length) {
+      ok = false;
+      std::memset(destination, 0, bytes);
+    } else {
+      std::memcpy(destination, buffer + (position - buffer_start), bytes);
+    }
+
+    position += bytes;
+  }
+
+private:
+  int descriptor;
+  uint64_t position{};
+  char buffer[4096]{};
+  uint64_t buffer_start{};
+  uint64_t buffer_length{};
+};
+
+// Checks if the file extension is one of the binary resource extensions.
+bool isBinaryResourcePath(const std::filesystem::path &file_path) {
+  for (const std::string &file_extension : BINARY_RESOURCE_EXTENSIONS) {
+    if (file_path.extension() == file_extension) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/*
+Reads the UID fields of a binary resource the way Godot's
+ResourceLoaderBinary does: seeks past the header to the resource's own UID,
+then over the string table to the external resource table, where each entry
+ends with the UID of the referenced resource. Fields holding an invalid UID are
+skipped. Returns false if the file isn't an uncompressed binary resource with
+UIDs.
+*/
+bool readBinaryUIDFields(int file_descriptor, bool &big_endian,
+                         std::vector<BinaryUIDField> &fields) {
+  BinaryResourceReader reader(file_descriptor);
+  char magic[4]{};
+  reader.read(magic, sizeof(magic));
+
+  if (std::memcmp(magic, "RSRC", sizeof(magic)) != 0) {
+    return false;
+  }
+
+  reader.big_endian = reader.read32() != 0;
+  big_endian = reader.big_endian;
+
+  // use_real64, major and minor version and format version
+  reader.skip(16);
+  reader.skipString();
+  // import metadata offset
+  reader.skip(8);
+
+  uint32_t flags{reader.read32()};
+
+  if (!(flags & BINARY_FORMAT_FLAG_UIDS)) {
+    return false;
+  }
+
+  uint64_t offset{reader.tell()};
+  uint64_t uid{reader.read64()};
+  fields.push_back({offset, uid, true});
+
+  if (flags & BINARY_FORMAT_FLAG_HAS_SCRIPT_CLASS) {
+    reader.skipString();
+  }
+
+  reader.skip(BINARY_RESERVED_FIELDS * 4);
+
+  for (uint32_t strings{reader.read32()}; strings > 0 && reader.ok;
+       strings--) {
+    reader.skipString();
+  }
+
+  for (uint32_t external_resources{reader.read32()};
+       external_resources > 0 && reader.ok; external_resources--) {
+    reader.skipString();
+    reader.skipString();
+
+    offset = reader.tell();
+    uid = reader.read64();
+    fields.push_back({offset, uid, false});
+  }
+
+  fields.erase(std::remove_if(fields.begin(), fields.end(),
+                              [](const BinaryUIDField &field) {
+                                return field.uid == INVALID_UID;
+                              }),
+               fields.end());
+
+  return reader.ok;
+}
+
+/*
+Collects a patch of each 8 byte UID field of a binary resource to patches, to
+be written with pwrite by applyPatches once the run commits.
+*/
+bool patchBinaryFile(const std::filesystem::path &file_path, bool big_endian,
+                     const std::vector<BinaryUIDField> &fields,
+                     const std::vector<uint64_t> &new_uids,
+                     std::vector<FilePatch> &patches, std::ostream &output) {
+  if (!backupFile(file_path, output)) {
+    return false;
+  }
+
+  patches.resize(fields.size());
+
+  for (size_t i = 0; i < fields.size(); i++) {
+    uint64_t old_value{big_endian ? __builtin_bswap64(fields[i].uid)
+                                  : fields[i].uid};
+    uint64_t new_value{big_endian ? __builtin_bswap64(new_uids[i])
+                                  : new_uids[i]};
+    FilePatch &patch{patches[i]};
+    patch.offset = fields[i].offset;
+    patch.length = sizeof(uint64_t);
+    std::memcpy(patch.old_bytes, &old_value, sizeof(old_value));
+    std::memcpy(patch.new_bytes, &new_value, sizeof(new_value));
+  }
+
+  output << "Patched " << fields.size() << " UID field(s) in place.\n";
+
+  return true;
+}
+
+const std::string CACHE_FILE_NAME{".godot-uid-fixer.cache"};
+const char CACHE_MAGIC[4]{'G', 'U', 'F', 'C'};
+// Version 3 decodes UIDs in base 34, older caches hold base 35 values.
+const uint32_t CACHE_VERSION{3};
+
+/*
+The UIDs each file declared when it was last indexed, with the inode, size
+and modification time the file had then. The cache file is a header followed
+by fixed size entries, a UID array and the paths, so it is used straight from
+a memory mapping. Entries are looked up by path without a leading "./", so
+files listed with -f and found by the walk share entries, and are only trusted
+while the file's inode, size and modification time are unchanged. Entries of
+files a run didn't index, such as those outside its -f list or read from
+Godot's editor cache, are kept as long as the file exists.
+*/
+class UIDCache {
+public:
+  explicit UIDCache(std::filesystem::path path) : cache_path{std::move(path)} {
+    int descriptor{open(cache_path.c_str(), O_RDONLY | O_CLOEXEC)};
+    struct stat cache_status{};
+
+    if (descriptor < 0) {
+      return;
+    }
+
+    if (fstat(descriptor, &cache_status) == 0 &&
+        static_cast<size_t>(cache_status.st_size) >= sizeof(Header)) {
+      mapped_file = std::make_unique<MappedFile>(descriptor,
+                                                 cache_status.st_size);
+    }
+
+    close(descriptor);
+
+    if (mapped_file && mapped_file->isValid()) {
+      load(mapped_file->view());
+    }
+  }
+
+  /*
+  Copies the cached UIDs declared by file_path to uids and the number of
+  malformed UIDs in it to malformed_uids if the file still has the inode, size
+  and modification time in file_status.
+  */
+  bool find(const std::filesystem::path &file_path,
+            const struct stat &file_status, std::vector<uint64_t> &uids,
+            uint32_t &malformed_uids) const {
+    auto entry_iterator{entries.find(cacheKey(file_path.native()))};
+
+    if (entry_iterator == entries.end()) {
+      return false;
+    }
+
+    const Entry &entry{*entry_iterator->second};
+
+    if (entry.inode != file_status.st_ino ||
+        entry.size != static_cast<uint64_t>(file_status.st_size) ||
+        entry.modification_time != modificationTime(file_status)) {
+      return false;
+    }
+
+    uids.assign(cached_uids + entry.uid_offset,
+                cached_uids + entry.uid_offset + entry.uid_count);
+    malformed_uids = entry.malformed_uids;
+
+    return true;
+  }
+
+  // Records the UIDs a file declares for the next save. Not thread safe.
+  void record(const std::filesystem::path &file_path,
+              const struct stat &file_status,
+              const std::vector<uint64_t> &uids, uint32_t malformed_uids) {
+    std::string_view key{cacheKey(file_path.native())};
+    auto entry_iterator{entries.find(key)};
+
+    if (entry_iterator != entries.end()) {
+      recorded[entry_iterator->second - cached_entries] = true;
+    }
+
+    Entry entry{};
+    entry.inode = file_status.st_ino;
+    entry.size = file_status.st_size;
+    entry.modification_time = modificationTime(file_status);
+    entry.path_offset = new_paths.size();
+    entry.path_length = key.size();
+    entry.uid_offset = new_uids.size();
+    entry.uid_count = uids.size();
+    entry.malformed_uids = malformed_uids;
+
+    new_entries.push_back(entry);
+    new_paths += key;
+    new_uids.insert(new_uids.end(), uids.begin(), uids.end());
+  }
+
+  /*
+  Replaces the cache file with the recorded entries and the loaded entries of
+  files that weren't recorded but still exist.
+  */
+  bool save() {
+    for (const auto &[key, cached_entry] : entries) {
+      std::string path{key};
+
+      if (recorded[cached_entry - cached_entries] ||
+          access(path.c_str(), F_OK) != 0) {
+        continue;
+      }
+
+      Entry entry{*cached_entry};
+      entry.path_offset = new_paths.size();
+      entry.uid_offset = new_uids.size();
+
+      new_entries.push_back(entry);
+      new_paths += key;
+      new_uids.insert(new_uids.end(), cached_uids + cached_entry->uid_offset,
+                      cached_uids + cached_entry->uid_offset +
+                          cached_entry->uid_count);
+    }
+
+    Header header{};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.entry_count = new_entries.size();
+    header.uid_count = new_uids.size();
+    header.path_bytes = new_paths.size();
+
+    std::vector<iovec> iovecs{
+        {&header, sizeof(header)},
+        {const_cast<Entry *>(new_entries.data()),
+         new_entries.size() * sizeof(Entry)},
+        {const_cast<uint64_t *>(new_uids.data()),
+         new_uids.size() * sizeof(uint64_t)},
+        {const_cast<char *>(new_paths.data()), new_paths.size()}};
+
+    std::filesystem::path tempfile_path(cache_path.string() + ".tmp");
+    int descriptor{open(tempfile_path.c_str(),
+                        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)};
+
+    if (descriptor < 0) {
+      return false;
+    }
+
+    bool written{writeVectors(descriptor, iovecs)};
+
+    if (close(descriptor) != 0 || !written ||
+        std::rename(tempfile_path.c_str(), cache_path.c_str()) != 0) {
+      std::remove(tempfile_path.c_str());
+
+      return false;
+    }
+
+    return true;
+  }
+
+private:
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t entry_count;
+    uint64_t uid_count;
+    uint64_t path_bytes;
+  };
+
+  struct Entry {
+    uint64_t inode;
+    uint64_t size;
+    int64_t modification_time;
+    uint64_t path_offset;
+    uint64_t uid_offset;
+    uint32_t path_length;
+    uint32_t uid_count;
+    uint32_t malformed_uids;
+    uint32_t reserved;
+  };
+
+  std::filesystem::path cache_path;
+  std::unique_ptr<MappedFile> mapped_file{};
+  std::unordered_map<std::string_view, const Entry *> entries{};
+  const Entry *cached_entries{};
+  const uint64_t *cached_uids{};
+  // set for each loaded entry whose file was recorded again
+  std::vector<bool> recorded{};
+
+  std::vector<Entry> new_entries{};
+  std::vector<uint64_t> new_uids{};
+  std::string new_paths{};
+
+  // Returns path without a leading "./", the key it is cached under.
+  static std::string_view cacheKey(std::string_view path) {
+    if (path.compare(0, 2, "./") == 0) {
+      path.remove_prefix(2);
+    }
+
+    return path;
+  }
+
+  static int64_t modificationTime(const struct stat &file_status) {
+    return static_cast<int64_t>(file_status.st_mtim.tv_sec) * 1000000000 +
+           file_status.st_mtim.tv_nsec;
+  }
+
+  // Indexes the entries of a mapped cache file, ignoring it if it's invalid.
+  void load(std::string_view data) {
+    Header header{};
+    std::memcpy(&header, data.data(), sizeof(header));
+
+    const uint64_t entries_end{sizeof(Header) +
+                               header.entry_count * sizeof(Entry)};
+    const uint64_t uids_end{entries_end + header.uid_count * sizeof(uint64_t)};
+
+    if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != CACHE_VERSION ||
+        header.entry_count > data.size() / sizeof(Entry) ||
+        header.uid_count > data.size() / sizeof(uint64_t) ||
+        uids_end + header.path_bytes != data.size()) {
+      return;
+    }
+
+    cached_entries =
+        reinterpret_cast<const Entry *>(data.data() + sizeof(Header));
+    const char *paths{data.data() + uids_end};
+    cached_uids = reinterpret_cast<const uint64_t *>(data.data() + entries_end);
+
+    entries.reserve(header.entry_count);
+
+    for (uint64_t i = 0; i < header.entry_count; i++) {
+      const Entry &entry{cached_entries[i]};
+
+      if (entry.path_offset + entry.path_length > header.path_bytes ||
+          entry.uid_offset + entry.uid_count > header.uid_count) {
+        entries.clear();
+
+        return;
+      }
+
+      entries.emplace(cacheKey(std::string_view(paths + entry.path_offset,
+                                                entry.path_length)),
+                      &entry);
+    }
+
+    recorded.resize(header.entry_count);
+  }
+};
+
+const std::filesystem::path GODOT_UID_CACHE_PATH{".godot/uid_cache.bin"};
+
+/*
+Godot's own map of every UID to the res:// path of its resource, written by
+ResourceUID as a little endian u32 entry count followed by a u64 UID, a u32
+path length and the path bytes per entry. The UIDs are ResourceUID integers,
+which decodeUID gives for the same text, so files found here and files that are
+read share one index. The file is used straight from a memory mapping and
+indexed by path in a single open addressing table, so loading it allocates
+nothing per entry. A file's UID is only trusted if the file was last modified
+before Godot wrote the cache.
+*/
+class GodotUIDCache {
+public:
+  explicit GodotUIDCache(const std::filesystem::path &cache_path) {
+    int descriptor{open(cache_path.c_str(), O_RDONLY | O_CLOEXEC)};
+
+    if (descriptor < 0) {
+      return;
+    }
+
+    if (fstat(descriptor, &cache_status) == 0 &&
+        cache_status.st_size >= static_cast<off_t>(sizeof(uint32_t))) {
+      mapped_file = std::make_unique<MappedFile>(descriptor,
+                                                 cache_status.st_size);
+    }
+
+    close(descriptor);
+
+    if (mapped_file && mapped_file->isValid()) {
+      load(mapped_file->view());
+    }
+  }
+
+  bool isValid() const { return !slots.empty(); }
+
+  size_t size() const { return entry_count; }
+
+  /*
+  Copies the UID Godot recorded for the resource of file_path to uids if the
+  file, as described by file_status, hasn't changed since the cache was
+  written. .import and .uid files are looked up by the resource they belong
+  to. Paths Godot recorded with more than one UID are never trusted.
+  */
+  bool find(const std::filesystem::path &file_path,
+            const struct stat &file_status,
+            std::vector<uint64_t> &uids) const {
+    if (!isValid() ||
+        !modifiedBefore(file_status.st_mtim, cache_status.st_mtim)) {
+      return false;
+    }
+
+    std::string_view path{file_path.native()};
+
+    if (path.compare(0, 2, "./") == 0) {
+      path.remove_prefix(2);
+    }
+
+    for (std::string_view suffix : {std::string_view{".import"},
+                                    std::string_view{".uid"}}) {
+      if (path.size() > suffix.size() &&
+          path.compare(path.size() - suffix.size(), suffix.size(), suffix) ==
+              0) {
+        path.remove_suffix(suffix.size());
+
+        break;
+      }
+    }
+
+    const Slot &slot{probe(path)};
+
+    if (slot.path_length == 0 || slot.uid == INVALID_UID) {
+      return false;
+    }
+
+    uids.assign(1, slot.uid);
+
+    return true;
+  }
+
+private:
+  // an empty slot has a path_length of 0
+  struct Slot {
+    uint64_t uid;
+    const char *path;
+    uint32_t path_length;
+  };
+
+  std::unique_ptr<MappedFile> mapped_file{};
+  struct stat cache_status{};
+  std::vector<Slot> slots{};
+  size_t entry_count{};
+
+  static bool modifiedBefore(const timespec &time, const timespec &other) {
+    return time.tv_sec < other.tv_sec ||
+           (time.tv_sec == other.tv_sec && time.tv_nsec < other.tv_nsec);
+  }
+
+  template <typename T> static T readLittleEndian(const char *data) {
+    T value{};
+    std::memcpy(&value, data, sizeof(value));
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    if constexpr (sizeof(T) == 8) {
+      value = __builtin_bswap64(value);
+    } else {
+      value = __builtin_bswap32(value);
+    }
+#endif
+
+    return value;
+  }
+
+  static uint64_t hashPath(std::string_view path) {
+    uint64_t hash{0xcbf29ce484222325ULL};
+
+    for (char character : path) {
+      hash = (hash ^ static_cast<unsigned char>(character)) *
+             0x100000001b3ULL;
+    }
+
+    return hash;
+  }
+
+  // Returns the slot holding path, or the empty slot where it would go.
+  Slot &probe(std::string_view path) {
+    return const_cast<Slot &>(std::as_const(*this).probe(path));
+  }
+
+  const Slot &probe(std::string_view path) const {
+    size_t mask{slots.size() - 1};
+
+    for (size_t index{hashPath(path) & mask};; index = (index + 1) & mask) {
+      const Slot &slot{slots[index]};
+
+      if (slot.path_length == 0 ||
+          std::string_view(slot.path, slot.path_length) == path) {
+        return slot;
+      }
+    }
+  }
+
+  /*
+  Indexes the entries of a mapped uid_cache.bin by their path without the
+  res:// prefix, ignoring the whole file if an entry runs past its end.
+  */
+  void load(std::string_view data) {
+    const uint32_t count{readLittleEndian<uint32_t>(data.data())};
+    // an entry takes at least 12 bytes, which bounds a corrupt count
+    size_t slot_count{16};
+
+    while (slot_count < std::min<size_t>(count, data.size() / 12) * 2) {
+      slot_count *= 2;
+    }
+
+    slots.assign(slot_count, Slot{INVALID_UID, nullptr, 0});
+    size_t offset{sizeof(uint32_t)};
+
+    for (uint32_t i = 0; i < count; i++) {
+      if (data.size() - offset < 12) {
+        slots.clear();
+
+        return;
+      }
+
+      uint64_t uid{readLittleEndian<uint64_t>(data.data() + offset)};
+      uint32_t length{readLittleEndian<uint32_t>(data.data() + offset + 8)};
+      offset += 12;
+
+      if (data.size() - offset < length) {
+        slots.clear();
+
+        return;
+      }
+
+      std::string_view path{data.substr(offset, length)};
+      offset += length;
+
+      if (path.compare(0, 6, "res://") != 0 || path.size() == 6) {
+        continue;
+      }
+
+      path.remove_prefix(6);
+      Slot &slot{probe(path)};
+
+      // a path recorded twice has a stale UID, so neither is trusted
+      if (slot.path_length != 0) {
+        slot.uid = INVALID_UID;
+
+        continue;
+      }
+
+      slot = {uid, path.data(), static_cast<uint32_t>(path.size())};
+      entry_count++;
+    }
+  }
+};
+
+/*
+What the pipeline does with each file. INDEX only collects the UIDs each file
+declares, DUPLICATES randomizes only declarations, REMAP replaces declarations
+and references using the project index and RANDOMIZE randomizes every UID.
+*/
+enum class RunMode { RANDOMIZE, INDEX, DUPLICATES, REMAP };
+
+/*
+A file on its way through the randomize pipeline. Each stage adds to it and
+logs to output, which is printed once the file has been committed.
+*/
+struct FileJob {
+  RunMode mode{RunMode::RANDOMIZE};
+  const ProjectIndex *project_index{};
+  const UIDCache *cache{};
+  const GodotUIDCache *godot_uid_cache{};
+  size_t sequence{};
+  std::filesystem::path file_path{};
+  std::ostringstream output{};
+  struct stat file_status{};
+  std::unique_ptr<MappedFile> mapped_file{};
+  // set for text resources whose UIDs are only looked for in their header, in
+  // INDEX and DUPLICATES mode
+  bool header_only{false};
+  // kept by keepTempfile, unnamed unless O_TMPFILE is unsupported
+  int tempfile_descriptor{-1};
+  std::filesystem::path tempfile_path{};
+  std::vector<uint64_t> declared_uids{};
+  uint32_t malformed_uids{};
+  // set when rewriteJob found nothing to replace
+  bool skipped{false};
+  // set when declared_uids came from the cache and the file wasn't opened
+  bool cached{false};
+  // set for binary resources, which are patched instead of mapped
+  bool binary{false};
+  bool big_endian{false};
+  std::vector<BinaryUIDField> binary_fields{};
+  // set when the UIDs are patched in place, applied by commitTransaction
+  std::vector<FilePatch> patches{};
+  bool succeeded{true};
+};
+
+/*
+Checks if only the header of the file in job is read: header_only is set and
+the file is only indexed or patched in place rather than rewritten.
+*/
+bool readsHeaderOnly(const FileJob &job) {
+  return job.header_only && (job.mode == RunMode::INDEX || in_place);
+}
+
+// Returns the part of buffer to look for UIDs in, its header if header_only.
+std::string_view scannedRegion(const FileJob &job, std::string_view buffer) {
+  return job.header_only ? buffer.substr(0, findHeaderEnd(buffer)) : buffer;
+}
+
+/*
+Looks up the UIDs of the file described by file_status in the cache, then in
+Godot's UID cache, and marks the job cached if either has them.
+*/
+bool findCachedUIDs(FileJob &job) {
+  if (job.cache && job.cache->find(job.file_path, job.file_status,
+                                   job.declared_uids, job.malformed_uids)) {
+    job.cached = true;
+
+    if (job.malformed_uids > 0) {
+      job.output << (check ? "ERROR: " : "WARNING: ") << job.malformed_uids
+                 << " malformed UID(s) (cached)\n";
+    }
+  } else if (job.godot_uid_cache &&
+             job.godot_uid_cache->find(job.file_path, job.file_status,
+                                       job.declared_uids)) {
+    job.cached = true;
+  }
+
+  return job.cached;
+}
+
+/*
+Opens and maps a regular file, faulting in its pages so the later stages don't
+wait on I/O, unless readsHeaderOnly, in which case only the pages of the header
+are read once it is scanned. Files whose UIDs are found by findCachedUIDs
+aren't opened.
+Binary resources aren't mapped, only their UID fields are read with
+readBinaryUIDFields. Other file types and files that can't be mapped are left
+unmapped and later passed to handleFileStream.
+*/
+void readFile(FileJob &job) {
+  job.output << "File: " << job.file_path.string() << '\n';
+
+  if ((job.cache || job.godot_uid_cache) &&
+      stat(job.file_path.c_str(), &job.file_status) == 0 &&
+      findCachedUIDs(job)) {
+    return;
+  }
+
+  int input_descriptor{open(job.file_path.c_str(), O_RDONLY | O_CLOEXEC)};
+
+  if (input_descriptor < 0 || fstat(input_descriptor, &job.file_status) != 0) {
+    if (input_descriptor >= 0) {
+      close(input_descriptor);
+    }
+
+    printFileErrorMessage(job.file_path, job.output);
+    job.succeeded = false;
+
+    return;
+  }
+
+  if (S_ISREG(job.file_status.st_mode) && isBinaryResourcePath(job.file_path)) {
+    job.binary = readBinaryUIDFields(input_descriptor, job.big_endian,
+                                     job.binary_fields);
+  }
+
+  if (S_ISREG(job.file_status.st_mode) && !job.binary) {
+    job.mapped_file = std::make_unique<MappedFile>(
+        input_descriptor, job.file_status.st_size, !readsHeaderOnly(job));
+
+    if (!job.mapped_file->isValid()) {
+      job.mapped_file.reset();
+    }
+  }
+
+  close(input_descriptor);
+}
+
+// Converts the fields of a statx result that FileJob uses to a struct stat.
+struct stat statToStat(const struct statx &extended_status) {
+  struct stat file_status{};
+  file_status.st_mode = extended_status.stx_mode;
+  file_status.st_size = extended_status.stx_size;
+  file_status.st_ino = extended_status.stx_ino;
+  file_status.st_mtim.tv_sec = extended_status.stx_mtime.tv_sec;
+  file_status.st_mtim.tv_nsec = extended_status.stx_mtime.tv_nsec;
+
+  return file_status;
+}
+
+// Checks if only a prefix of the file in job is read, enough for its header.
+bool readsPrefix(const FileJob &job) {
+  return job.mode == RunMode::INDEX && job.header_only;
+}
+
+/*
+Reads a batch of files with io_uring in four rounds of submissions, statx,
+openat, read and close, so a batch costs four system calls however many files
+it holds, instead of four or more per file. Each file is read into a buffer
+one byte larger than its size, and only kept if exactly its size was read, so
+files that grew or shrank since statx and short reads are passed to readFile,
+as are binary resources and files too large for one read. Text resources that
+are only indexed are read up to HEADER_READ_SIZE bytes and passed to readFile
+if their header doesn't end within what was read. The batch must not hold more
+files than ring has entries. If the ring fails, the files it hasn't read are
+read with readFile and false is returned, so the caller stops using it.
+*/
+bool readFileBatch(IOUring &ring, const std::vector<FileJob *> &batch) {
+  std::vector<FileJob *> pending{};
+
+  for (FileJob *job : batch) {
+    if (isBinaryResourcePath(job->file_path)) {
+      readFile(*job);
+    } else {
+      job->output << "File: " << job->file_path.string() << '\n';
+      pending.push_back(job);
+    }
+  }
+
+  std::vector<struct statx> statuses(pending.size());
+  std::vector<int> descriptors(pending.size(), -1);
+  std::vector<std::string> contents(pending.size());
+  std::vector<bool> completed(pending.size());
+  // set once submitAndWait failed, no further rounds are run
+  bool ring_failed{false};
+
+  auto fail{[&](size_t i) {
+    printFileErrorMessage(pending[i]->file_path, pending[i]->output);
+    pending[i]->succeeded = false;
+  }};
+
+  /*
+  Queues the operation returned by submit for each file still being read, or
+  none if it returns null, then waits for all of them and passes each result
+  to complete. Files whose operation didn't complete are failed, unless the
+  ring failed, in which case they are left to readFile.
+  */
+  auto runRound{[&](auto &&submit, auto &&complete) {
+    if (ring_failed) {
+      return;
+    }
+
+    unsigned submitted{};
+
+    for (size_t i = 0; i < pending.size(); i++) {
+      completed[i] = true;
+
+      if (!pending[i]->succeeded || pending[i]->cached) {
+        continue;
+      }
+
+      if (io_uring_sqe *submission{submit(i)}) {
+        submission->user_data = i;
+        completed[i] = false;
+        submitted++;
+      }
+    }
+
+    io_uring_cqe completion{};
+
+    if (submitted > 0) {
+      ring_failed = !ring.submitAndWait(submitted);
+
+      while (ring.popCompletion(completion)) {
+        completed[completion.user_data] = true;
+        complete(completion.user_data, completion.res);
+      }
+    }
+
+    for (size_t i = 0; i < pending.size(); i++) {
+      if (!completed[i] && !ring_failed) {
+        fail(i);
+      }
+    }
+  }};
+
+  runRound(
+      [&](size_t i) {
+        io_uring_sqe *submission{ring.getSubmission()};
+        submission->opcode = IORING_OP_STATX;
+        submission->fd = AT_FDCWD;
+        submission->addr =
+            reinterpret_cast<uintptr_t>(pending[i]->file_path.c_str());
+        submission->len = STATX_BASIC_STATS;
+        submission->off = reinterpret_cast<uintptr_t>(&statuses[i]);
+
+        return submission;
+      },
+      [&](size_t i, int result) {
+        FileJob &job{*pending[i]};
+
+        if (result < 0) {
+          fail(i);
+
+          return;
+        }
+
+        job.file_status = statToStat(statuses[i]);
+        findCachedUIDs(job);
+      });
+
+  runRound(
+      [&](size_t i) -> io_uring_sqe * {
+        // other file types are left unmapped, as by readFile
+        if (!S_ISREG(pending[i]->file_status.st_mode)) {
+          return nullptr;
+        }
+
+        io_uring_sqe *submission{ring.getSubmission()};
+        submission->opcode = IORING_OP_OPENAT;
+        submission->fd = AT_FDCWD;
+        submission->addr =
+            reinterpret_cast<uintptr_t>(pending[i]->file_path.c_str());
+        submission->open_flags = O_RDONLY | O_CLOEXEC;
+
+        return submission;
+      },
+      [&](size_t i, int result) {
+        if (result < 0) {
+          fail(i);
+        } else {
+          descriptors[i] = result;
+        }
+      });
+
+  runRound(
+      [&](size_t i) -> io_uring_sqe * {
+        if (descriptors[i] < 0) {
+          return nullptr;
+        }
+
+        size_t read_size{
+            static_cast<size_t>(pending[i]->file_status.st_size) + 1};
+
+        // an index only needs the header, which a prefix usually holds
+        if (readsPrefix(*pending[i])) {
+          read_size = std::min(read_size, HEADER_READ_SIZE);
+        }
+
+        // the read length is 32 bits, larger files are left to readFile
+        if (read_size > UINT32_MAX) {
+          return nullptr;
+        }
+
+        contents[i].resize(read_size);
+        io_uring_sqe *submission{ring.getSubmission()};
+        submission->opcode = IORING_OP_READ;
+        submission->fd = descriptors[i];
+        submission->addr = reinterpret_cast<uintptr_t>(contents[i].data());
+        submission->len = contents[i].size();
+
+        return submission;
+      },
+      [&](size_t i, int result) {
+        size_t file_size{
+            static_cast<size_t>(pending[i]->file_status.st_size)};
+
+        if (result < 0) {
+          fail(i);
+
+          return;
+        }
+
+        // a short read may have hit a shrinking file or been cut short, so
+        // only the whole file or a prefix holding the whole header is kept
+        std::string_view read{contents[i].data(),
+                              static_cast<size_t>(result)};
+
+        if (read.size() == file_size ||
+            (readsPrefix(*pending[i]) && read.size() < file_size &&
+             findHeaderEnd(read) < read.size())) {
+          contents[i].resize(result);
+          pending[i]->mapped_file =
+              std::make_unique<MappedFile>(std::move(contents[i]));
+        }
+      });
+
+  // closes every opened file whatever happened to it, so results are ignored
+  unsigned opened{};
+  io_uring_cqe completion{};
+
+  for (size_t i = 0; i < pending.size(); i++) {
+    completed[i] = descriptors[i] < 0;
+
+    if (!completed[i] && !ring_failed) {
+      io_uring_sqe *submission{ring.getSubmission()};
+      submission->opcode = IORING_OP_CLOSE;
+      submission->fd = descriptors[i];
+      submission->user_data = i;
+      opened++;
+    }
+  }
+
+  if (opened > 0) {
+    ring_failed = !ring.submitAndWait(opened);
+
+    while (ring.popCompletion(completion)) {
+      completed[completion.user_data] = true;
+    }
+  }
+
+  for (size_t i = 0; i < pending.size(); i++) {
+    if (!completed[i]) {
+      close(descriptors[i]);
+    }
+  }
+
+  for (size_t i = 0; i < pending.size(); i++) {
+    FileJob &job{*pending[i]};
+
+    if (job.succeeded && !job.cached && !job.mapped_file &&
+        (descriptors[i] >= 0 || ring_failed)) {
+      job.output.str("");
+      readFile(job);
+    }
+  }
+
+  return !ring_failed;
+}
+
+// Prints the line number and text of a UID that can't be decoded.
+void printMalformedUIDMessage(std::string_view buffer, const UIDSpan &span,
+                              std::ostream &output) {
+  size_t line_number{1 + static_cast<size_t>(std::count(
+                             buffer.begin(), buffer.begin() + span.offset,
+                             '\n'))};
+
+  output << (check ? "ERROR" : "WARNING") << ": Malformed UID on line "
+         << line_number << ": " << UID_PREFIX
+         << buffer.substr(span.offset, span.length) << '\n';
+}
+
+/*
+Decodes the UIDs declared by a mapped file into declared_uids and reports
+UIDs that can't be decoded or are longer than any UID Godot writes. The UID
+fields of binary resources are only used if the whole table could be read.
+*/
+void indexJob(FileJob &job) {
+  if (job.binary) {
+    for (const BinaryUIDField &field : job.binary_fields) {
+      if (field.declaration) {
+        job.declared_uids.push_back(field.uid);
+      }
+    }
+  }
+
+  if (!job.mapped_file) {
+    return;
+  }
+
+  std::string_view buffer{job.mapped_file->view()};
+  static thread_local std::vector<UIDSpan> spans{};
+  spans.clear();
+  findUIDs(scannedRegion(job, buffer), spans);
+
+  static thread_local std::vector<uint64_t> uids{};
+  uids.resize(spans.size());
+  decode_uid_batch(buffer, spans.data(), spans.size(), uids.data());
+
+  for (size_t i = 0; i < spans.size(); i++) {
+    if (uids[i] == INVALID_UID || spans[i].length > MAX_UID_LENGTH) {
+      printMalformedUIDMessage(buffer, spans[i], job.output);
+      job.malformed_uids++;
+    } else if (spans[i].declaration) {
+      job.declared_uids.push_back(uids[i]);
+    }
+  }
+
+  job.mapped_file.reset();
+}
+
+/*
+Replaces the generated UIDs in new_uids with the remapped UIDs from the
+project index. A declaration keeps its generated UID only if the file doesn't
+own it because another file declared it first. References to UIDs that no file
+declares are left alone and removed from spans.
+*/
+void remapSpans(const FileJob &job, std::string_view buffer,
+                std::vector<UIDSpan> &spans, std::vector<uint64_t> &new_uids) {
+  const ProjectIndex &project_index{*job.project_index};
+  static thread_local std::vector<uint64_t> uids{};
+  uids.resize(spans.size());
+  decode_uid_batch(buffer, spans.data(), spans.size(), uids.data());
+
+  size_t kept{};
+
+  for (size_t i = 0; i < spans.size(); i++) {
+    const uint32_t *owner{project_index.uid_index.find(uids[i])};
+    const uint64_t *remapped{project_index.remapped_uids.find(uids[i])};
+    bool owned{owner && project_index.declaring_files[*owner] == job.file_path};
+
+    if (remapped && (owned || !spans[i].declaration)) {
+      new_uids[kept] = *remapped;
+    } else if (spans[i].declaration) {
+      new_uids[kept] = new_uids[i];
+    } else {
+      continue;
+    }
+
+    spans[kept++] = spans[i];
+  }
+
+  spans.resize(kept);
+  new_uids.resize(kept);
+}
+
+/*
+Picks new values for the UID fields of a binary resource by the same rules as
+the text UIDs in rewriteJob and remapSpans, then patches them in place with
+patchBinaryFile.
+*/
+void rewriteBinaryJob(FileJob &job) {
+  std::vector<BinaryUIDField> fields{};
+  std::vector<uint64_t> new_uids{};
+
+  for (const BinaryUIDField &field : job.binary_fields) {
+    uint64_t new_uid{uid_generator.nextUID()};
+
+    if (job.mode == RunMode::DUPLICATES && !field.declaration) {
+      continue;
+    }
+
+    if (job.mode == RunMode::REMAP) {
+      const ProjectIndex &project_index{*job.project_index};
+      const uint32_t *owner{project_index.uid_index.find(field.uid)};
+      const uint64_t *remapped{project_index.remapped_uids.find(field.uid)};
+      bool owned{owner &&
+                 project_index.declaring_files[*owner] == job.file_path};
+
+      if (remapped && (owned || !field.declaration)) {
+        new_uid = *remapped;
+      } else if (!field.declaration) {
+        continue;
+      }
+    }
+
+    if (verbose) {
+      job.output << "Replacing UID field at offset " << field.offset << '\n';
+      job.output << "[UID: " << encodeUID(field.uid)
+                 << " | New UID: " << encodeUID(new_uid) << "]\n";
+    }
+
+    fields.push_back(field);
+    new_uids.push_back(new_uid);
+  }
+
+  if (fields.empty()) {
+    job.skipped = true;
+
+    return;
+  }
+
+  job.succeeded = patchBinaryFile(job.file_path, job.big_endian, fields,
+                                  new_uids, job.patches, job.output);
+}
+
+/*
+Finds every UID in a mapped file in a single pass over the buffer, then
+generates a new UID for each one, or only for declarations in DUPLICATES mode.
+In REMAP mode the new UIDs come from remapSpans. If in place patching is
+enabled and every old UID is as long as its replacement the UIDs are patched
+in place with patchFileInPlace, otherwise the file is rewritten with
+rewriteFile. Either way nothing is changed before commitTransaction. Files
+without UIDs to replace are skipped, so neither their contents nor their
+modification times change. Unmapped files are passed to handleFileStream in
+RANDOMIZE mode and skipped otherwise, as they weren't indexed. The span and UID
+buffers are kept per thread, so once they have grown to fit the largest file
+scanning allocates nothing.
+*/
+void rewriteJob(FileJob &job) {
+  if (job.cached) {
+    return;
+  }
+
+  if (job.mode == RunMode::INDEX) {
+    indexJob(job);
+
+    return;
+  }
+
+  if (job.binary) {
+    rewriteBinaryJob(job);
+
+    return;
+  }
+
+  if (!job.mapped_file) {
+    if (job.mode == RunMode::RANDOMIZE) {
+      job.succeeded = handleFileStream(job.file_path, job.output);
+    }
+
+    return;
+  }
+
+  // reused by every file this thread rewrites
+  static thread_local std::vector<UIDSpan> spans{};
+  static thread_local std::vector<uint64_t> new_uid_values{};
+  static thread_local EncodedUIDs new_uids{};
+
+  std::string_view buffer{job.mapped_file->view()};
+  spans.clear();
+  findUIDs(scannedRegion(job, buffer), spans);
+
+  if (job.mode == RunMode::DUPLICATES) {
+    spans.erase(std::remove_if(spans.begin(), spans.end(),
+                               [](const UIDSpan &span) {
+                                 return !span.declaration;
+                               }),
+                spans.end());
+  }
+
+  // new UIDs as long as the old ones keep in place patching possible, other
+  // runs use the full 63 bits so short UIDs don't collide
+  new_uid_values.resize(spans.size());
+
+  if (in_place) {
+    for (size_t i = 0; i < spans.size(); i++) {
+      new_uid_values[i] = uid_generator.nextUID(spans[i].length);
+    }
+  } else {
+    uid_generator.generateBatch(new_uid_values.data(), new_uid_values.size());
+  }
+
+  if (job.mode == RunMode::REMAP) {
+    remapSpans(job, buffer, spans, new_uid_values);
+  }
+
+  if (spans.empty()) {
+    job.skipped = true;
+    job.mapped_file.reset();
+
+    return;
+  }
+
+  new_uids.assign(new_uid_values);
+  bool same_length{true};
+
+  for (size_t i = 0; i < spans.size(); i++) {
+    const UIDSpan &span{spans[i]};
+
+    same_length = same_length && span.length == new_uids[i].size();
+
+    if (verbose) {
+      job.output << "Replacing line: " << lineAt(buffer, span.offset) << '\n';
+      job.output << "[UID: " << buffer.substr(span.offset, span.length)
+                 << " | New UID: " << new_uids[i] << "]\n";
+    }
+  }
+
+  if (in_place && same_length) {
+    job.succeeded = patchFileInPlace(job.file_path, buffer, spans, new_uids,
+                                     job.patches, job.output);
+  } else {
+    job.succeeded =
+        rewriteFile(job.file_path, job.file_status.st_mode, buffer, spans,
+                    new_uids, job.tempfile_descriptor, job.tempfile_path,
+                    job.output);
+  }
+
+  job.mapped_file.reset();
+}
+
+/*
+A file whose replacement rewriteFile wrote to a temporary file, waiting for its
+name to be journaled so stageFile can link it.
+*/
+struct StagedFile {
+  std::filesystem::path file_path;
+  int tempfile_descriptor;
+  // set if openTempfile had to create <name>.tmp itself
+  std::filesystem::path tempfile_path;
+};
+
+/*
+Links the unnamed temporary file kept by keepTempfile into the directory of
+the old file as <name>.tmp, where commitTransaction renames it over the old
+file once every file of the run has been staged. The name must be in the
+journal first. A <name>.tmp already in the way wasn't made by this run, so it
+is left alone and the file fails.
+*/
+bool stageFile(StagedFile &staged_file, std::ostream &output) {
+  bool linked{true};
+
+  if (staged_file.tempfile_path.empty()) {
+    std::string descriptor_path{
+        "/proc/self/fd/" + std::to_string(staged_file.tempfile_descriptor)};
+    linked = linkat(AT_FDCWD, descriptor_path.c_str(), AT_FDCWD,
+                    tempfilePath(staged_file.file_path).c_str(),
+                    AT_SYMLINK_FOLLOW) == 0;
+  }
+
+  close(staged_file.tempfile_descriptor);
+  staged_file.tempfile_descriptor = -1;
+
+  if (!linked) {
+    printFileErrorMessage(staged_file.file_path, output);
+
+    return false;
+  }
+
+  return true;
+}
+
+// Syncs each directory so the renames done by commitTransaction survive a
+// crash.
+void syncDirectories(const std::set<std::filesystem::path> &directories) {
+  for (const std::filesystem::path &directory : directories) {
+    int descriptor{open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+
+    if (descriptor >= 0) {
+      fsync(descriptor);
+      close(descriptor);
+    }
+  }
+}
+
+// Holds the journal and the original of each file replaced by the last run.
+const std::filesystem::path UNDO_DIRECTORY{".godot-uid-fixer.undo"};
+const std::filesystem::path JOURNAL_PATH{UNDO_DIRECTORY / "journal"};
+
+// Path in UNDO_DIRECTORY of the original of the staged file at index.
+std::filesystem::path undoPath(size_t index) {
+  return UNDO_DIRECTORY / std::to_string(index);
+}
+
+// The changes of a run, as listed in its journal.
+struct JournalRecords {
+  // files whose replacement was staged as <name>.tmp, in journal order
+  std::vector<std::filesystem::path> staged_files{};
+  std::vector<std::pair<std::filesystem::path, std::vector<FilePatch>>>
+      patched_files{};
+  bool committed{false};
+};
+
+/*
+Undoes the changes in records: writes the old bytes of the first patched_count
+patched files back, renames the originals saved in UNDO_DIRECTORY back over the
+staged files, last file first, and unless the run committed removes the
+<name>.tmp files it staged. UNDO_DIRECTORY is removed last. Returns the number
+of files restored.
+*/
+size_t restoreFiles(const JournalRecords &records, size_t patched_count) {
+  size_t restored{};
+
+  for (size_t i = patched_count; i-- > 0;) {
+    const auto &[file_path, patches]{records.patched_files[i]};
+    restored += applyPatches(file_path, patches, true);
+  }
+
+  for (size_t i = records.staged_files.size(); i-- > 0;) {
+    const std::filesystem::path &file_path{records.staged_files[i]};
+
+    if (std::rename(undoPath(i).c_str(), file_path.c_str()) == 0) {
+      restored++;
+    }
+
+    if (!records.committed) {
+      std::remove(tempfilePath(file_path).c_str());
+    }
+  }
+
+  std::error_code error_code{};
+  std::filesystem::remove_all(UNDO_DIRECTORY, error_code);
+
+  return restored;
+}
+
+// Reads the records of the journal at JOURNAL_PATH, false if there is none.
+bool readJournal(JournalRecords &records) {
+  std::ifstream journal_stream(JOURNAL_PATH, std::ios::binary);
+
+  if (!journal_stream.is_open()) {
+    return false;
+  }
+
+  std::string field{};
+  auto next{[&] { return !!std::getline(journal_stream, field, '\0'); }};
+
+  while (next()) {
+    if (field == "staged" && next()) {
+      records.staged_files.push_back(field);
+    } else if (field == "patched" && next()) {
+      std::filesystem::path file_path{field};
+      FilePatch patch{};
+
+      if (!next() || std::from_chars(field.data(),
+                                     field.data() + field.size(),
+                                     patch.offset)
+                             .ec != std::errc{}) {
+        break;
+      }
+
+      if (!next() || field.size() % 2 != 0 ||
+          field.size() / 2 > MAX_PATCH_LENGTH) {
+        break;
+      }
+
+      patch.length = static_cast<uint8_t>(field.size() / 2);
+
+      for (size_t i = 0; i < patch.length; i++) {
+        patch.old_bytes[i] =
+            static_cast<char>(std::stoi(field.substr(i * 2, 2), nullptr, 16));
+      }
+
+      if (records.patched_files.empty() ||
+          records.patched_files.back().first != file_path) {
+        records.patched_files.emplace_back(file_path,
+                                           std::vector<FilePatch>{});
+      }
+
+      records.patched_files.back().second.push_back(patch);
+    } else if (field == "committed") {
+      records.committed = true;
+    }
+  }
+
+  return true;
+}
+
+/*
+Writes the journal of a run to JOURNAL_PATH as null separated records:
+"staged" and the path of a file whose replacement is about to be linked as
+<name>.tmp, "patched", a path, an offset and the hex of the bytes there before
+they are patched, and "committed" once every change was made. Records are
+synced before the changes they list are made, so the next run or --undo can
+roll back an interrupted run, and only <name>.tmp files the journal lists are
+ever removed. The records are also kept in memory to roll back a failed
+commit.
+*/
+class UndoJournal {
+public:
+  UndoJournal() = default;
+  UndoJournal(const UndoJournal &) = delete;
+  UndoJournal &operator=(const UndoJournal &) = delete;
+
+  ~UndoJournal() {
+    if (descriptor >= 0) {
+      close(descriptor);
+    }
+  }
+
+  bool isOpen() const { return descriptor >= 0; }
+
+  const JournalRecords &records() const { return journal_records; }
+
+  /*
+  Replaces the journal of the last run with an empty one. An interrupted run
+  must have been rolled back with rollBackInterruptedRun first.
+  */
+  bool begin() {
+    std::error_code error_code{};
+    std::filesystem::remove_all(UNDO_DIRECTORY, error_code);
+
+    if (!std::filesystem::create_directory(UNDO_DIRECTORY, error_code)) {
+      return false;
+    }
+
+    descriptor = open(JOURNAL_PATH.c_str(),
+                      O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+                      0644);
+
+    if (descriptor < 0) {
+      return false;
+    }
+
+    syncDirectories({UNDO_DIRECTORY, "."});
+
+    return true;
+  }
+
+  void stage(const std::filesystem::path &file_path) {
+    appendField("staged");
+    appendField(file_path.native());
+    journal_records.staged_files.push_back(file_path);
+  }
+
+  // Drops a staged file that wasn't linked, so rollBack leaves its name alone.
+  void unstage(const std::filesystem::path &file_path) {
+    auto &staged_files{journal_records.staged_files};
+    staged_files.erase(
+        std::find(staged_files.begin(), staged_files.end(), file_path));
+  }
+
+  void patch(const std::filesystem::path &file_path,
+             const std::vector<FilePatch> &patches) {
+    for (const FilePatch &patch : patches) {
+      appendField("patched");
+      appendField(file_path.native());
+      appendField(std::to_string(patch.offset));
+
+      static const char HEX_DIGITS[]{"0123456789abcdef"};
+      std::string hex{};
+
+      for (size_t i = 0; i < patch.length; i++) {
+        unsigned char byte{static_cast<unsigned char>(patch.old_bytes[i])};
+        hex += HEX_DIGITS[byte >> 4];
+        hex += HEX_DIGITS[byte & 0xf];
+      }
+
+      appendField(hex);
+    }
+
+    journal_records.patched_files.emplace_back(file_path, patches);
+  }
+
+  void commit() {
+    appendField("committed");
+    journal_records.committed = true;
+  }
+
+  // Writes the records added since the last call and syncs them.
+  bool sync() {
+    std::vector<iovec> iovecs{{pending.data(), pending.size()}};
+    bool written{writeVectors(descriptor, iovecs) &&
+                 fdatasync(descriptor) == 0};
+    pending.clear();
+
+    return written;
+  }
+
+  /*
+  Undoes the changes listed so far, of which the first patched_count patched
+  files were already patched, and removes the journal. Returns the number of
+  files restored.
+  */
+  size_t rollBack(size_t patched_count) {
+    close(descriptor);
+    descriptor = -1;
+
+    return restoreFiles(journal_records, patched_count);
+  }
+
+private:
+  int descriptor{-1};
+  JournalRecords journal_records{};
+  std::string pending{};
+
+  void appendField(std::string_view field) {
+    pending.append(field);
+    pending += '\0';
+  }
+};
+
+/*
+Makes the changes listed in journal as one transaction. The journal must be
+synced, listing every staged file and every patch. Each original staged file
+is hard linked into UNDO_DIRECTORY before its <name>.tmp is renamed over it,
+then the patches are written in place. If any step fails the changes already
+made are undone and the staged files removed, so the project is either fully
+rewritten or left as it was. The originals are kept for undoTransaction.
+*/
+bool commitTransaction(UndoJournal &journal, std::ostream &output) {
+  const JournalRecords &records{journal.records()};
+  std::set<std::filesystem::path> directories{};
+
+  for (size_t i = 0; i < records.staged_files.size(); i++) {
+    const std::filesystem::path &file_path{records.staged_files[i]};
+
+    if (link(file_path.c_str(), undoPath(i).c_str()) != 0 ||
+        std::rename(tempfilePath(file_path).c_str(), file_path.c_str()) != 0) {
+      printFileErrorMessage(file_path, output);
+      output << "Restored " << journal.rollBack(0) << " file(s).\n";
+
+      return false;
+    }
+
+    directories.insert(parentDirectory(file_path));
+  }
+
+  for (size_t i = 0; i < records.patched_files.size(); i++) {
+    const auto &[file_path, patches]{records.patched_files[i]};
+
+    if (!applyPatches(file_path, patches)) {
+      printFileErrorMessage(file_path, output);
+      // the failed file may be partly patched
+      output << "Restored " << journal.rollBack(i + 1) << " file(s).\n";
+
+      return false;
+    }
+  }
+
+  journal.commit();
+
+  if (!journal.sync()) {
+    output << "ERROR: Unable to write " << JOURNAL_PATH.string() << '\n';
+    output << "Restored "
+           << journal.rollBack(records.patched_files.size()) << " file(s).\n";
+
+    return false;
+  }
+
+  directories.insert(UNDO_DIRECTORY);
+  syncDirectories(directories);
+
+  return true;
+}
+
+/*
+Reads the journal of the last run and restores the original of every file it
+replaced and the old bytes of every file it patched.
+*/
+bool undoTransaction() {
+  JournalRecords records{};
+
+  if (!readJournal(records)) {
+    std::cout << "ERROR: No run to undo, " << JOURNAL_PATH.string()
+              << " not found.\n";
+
+    return false;
+  }
+
+  std::cout << "Restored "
+            << restoreFiles(records, records.patched_files.size()) << " of "
+            << records.staged_files.size() + records.patched_files.size()
+            << " file(s).\n";
+
+  return true;
+}
+
+/*
+Rolls back the run of the journal in UNDO_DIRECTORY if it never committed,
+such as one killed while committing, before files are read for a new run.
+*/
+void rollBackInterruptedRun() {
+  JournalRecords records{};
+
+  if (readJournal(records) && !records.committed) {
+    std::cout << "Rolled back "
+              << restoreFiles(records, records.patched_files.size())
+              << " file(s) of an interrupted run.\n";
+  }
+}
+
+/*
+Matches character against the "[...]" set starting at pattern[position] and
+stores the position after its closing bracket in end. Returns false without
+setting end if the set isn't closed, so the bracket is matched literally.
+*/
+bool matchCharacterSet(std::string_view pattern, size_t position,
+                       char character, size_t &end) {
+  size_t q{position + 1};
+  bool negated{q < pattern.size() && (pattern[q] == '!' || pattern[q] == '^')};
+  bool matched{false};
+  q += negated;
+
+  // a "]" right after the opening bracket is part of the set
+  for (size_t first{q}; q < pattern.size(); q++) {
+    if (pattern[q] == ']' && q != first) {
+      end = q + 1;
+
+      return matched != negated && character != '/';
+    }
+
+    if (q + 2 < pattern.size() && pattern[q + 1] == '-' &&
+        pattern[q + 2] != ']') {
+      matched =
+          matched || (pattern[q] <= character && character <= pattern[q + 2]);
+      q += 2;
+    } else {
+      matched = matched || pattern[q] == character;
+    }
+  }
+
+  end = std::string_view::npos;
+
+  return false;
+}
+
+/*
+Matches text against a glob pattern without allocating. "*" and "?" don't
+match "/", "**" matches anything including "/", and "[...]" matches one
+character of a set or range, negated by a leading "!" or "^". Backtracks to the
+last "*", or to the last "**" once a "*" would have to cross a "/".
+*/
+bool matchGlob(std::string_view pattern, std::string_view text) {
+  // resume points of the last "*" and "**", npos while there is none
+  size_t star_pattern{std::string_view::npos};
+  size_t star_text{};
+  size_t double_star_pattern{std::string_view::npos};
+  size_t double_star_text{};
+  size_t p{};
+  size_t t{};
+
+  while (t < text.size()) {
+    if (p < pattern.size() && pattern[p] == '*') {
+      if (p + 1 < pattern.size() && pattern[p + 1] == '*') {
+        p += 2;
+        double_star_pattern = p;
+        double_star_text = t;
+        star_pattern = std::string_view::npos;
+      } else {
+        p++;
+        star_pattern = p;
+        star_text = t;
+      }
+
+      continue;
+    }
+
+    size_t set_end{};
+
+    if (p < pattern.size() && pattern[p] == '[' &&
+        matchCharacterSet(pattern, p, text[t], set_end)) {
+      p = set_end;
+      t++;
+
+      continue;
+    }
+
+    bool unclosed_set{p < pattern.size() && pattern[p] == '[' &&
+                      set_end == std::string_view::npos};
+
+    if (p < pattern.size() && (pattern[p] != '[' || unclosed_set) &&
+        (pattern[p] == text[t] || (pattern[p] == '?' && text[t] != '/'))) {
+      p++;
+      t++;
+
+      continue;
+    }
+
+    if (star_pattern != std::string_view::npos && text[star_text] != '/') {
+      p = star_pattern;
+      t = ++star_text;
+    } else if (double_star_pattern != std::string_view::npos) {
+      p = double_star_pattern;
+      t = ++double_star_text;
+      star_pattern = std::string_view::npos;
+    } else {
+      return false;
+    }
+  }
+
+  while (p < pattern.size() && pattern[p] == '*') {
+    p++;
+  }
+
+  return p == pattern.size();
+}
+
+/*
+Decides which files are randomized. The supported extensions and every
+--include pattern of the form "*.ext" with a single dot are compiled into a
+collision free hash table, so the usual check is one hash of the extension
+after the last dot and one comparison.
+Other --include patterns and the --exclude patterns are matched with matchGlob
+against the path relative to the current directory and against the name.
+Nothing is allocated while matching.
+*/
+class PathMatcher {
+public:
+  void compile(const std::vector<std::string> &includes,
+               const std::vector<std::string> &excludes) {
+    extensions.assign(std::begin(SUPPORTED_FILE_EXTENSIONS),
+                      std::end(SUPPORTED_FILE_EXTENSIONS));
+    include_globs.clear();
+    exclude_globs = excludes;
+
+    for (const std::string &pattern : includes) {
+      // selects only looks up the part of a name after its last dot
+      bool extension_only{pattern.size() > 2 &&
+                          pattern.compare(0, 2, "*.") == 0 &&
+                          pattern.find_first_of("*?[/.", 2) ==
+                              std::string::npos};
+
+      if (extension_only) {
+        extensions.push_back(pattern.substr(1));
+      } else {
+        include_globs.push_back(pattern);
+      }
+    }
+
+    // doubles the table until no two extensions share a slot
+    for (size_t slot_count{16};; slot_count *= 2) {
+      slots.assign(slot_count, 0);
+      slot_mask = slot_count - 1;
+      bool collided{false};
+
+      for (size_t i = 0; i < extensions.size() && !collided; i++) {
+        uint16_t &slot{slots[hashExtension(extensions[i]) & slot_mask]};
+        collided = slot != 0 && extensions[slot - 1] != extensions[i];
+        slot = collided ? slot : static_cast<uint16_t>(i + 1);
+      }
+
+      if (!collided) {
+        break;
+      }
+    }
+  }
+
+  // Checks if the file at path has a selected extension or matches --include.
+  bool selects(const std::filesystem::path &path) const {
+    std::string_view name{nameOf(path.native())};
+    size_t dot{name.rfind('.')};
+
+    if (dot != std::string_view::npos && dot > 0) {
+      std::string_view extension{name.substr(dot)};
+      uint16_t slot{slots[hashExtension(extension) & slot_mask]};
+
+      if (slot != 0 && extensions[slot - 1] == extension) {
+        return true;
+      }
+    }
+
+    return matchesAny(include_globs, path.native());
+  }
+
+  // Checks if path or its name matches an --exclude pattern.
+  bool excludes(const std::filesystem::path &path) const {
+    return matchesAny(exclude_globs, path.native());
+  }
+
+private:
+  std::vector<std::string> extensions{};
+  // index + 1 of the extension hashed to each slot, 0 for empty slots
+  std::vector<uint16_t> slots{};
+  size_t slot_mask{};
+  std::vector<std::string> include_globs{};
+  std::vector<std::string> exclude_globs{};
+
+  static uint64_t hashExtension(std::string_view extension) {
+    uint64_t hash{0xcbf29ce484222325ULL};
+
+    for (char character : extension) {
+      hash = (hash ^ static_cast<unsigned char>(character)) *
+             0x100000001b3ULL;
+    }
+
+    return hash ^ (hash >> 32);
+  }
+
+  static std::string_view nameOf(std::string_view path) {
+    size_t slash{path.rfind('/')};
+
+    return slash == std::string_view::npos ? path : path.substr(slash + 1);
+  }
+
+  static bool matchesAny(const std::vector<std::string> &globs,
+                         std::string_view path) {
+    if (path.compare(0, 2, "./") == 0) {
+      path.remove_prefix(2);
+    }
+
+    std::string_view name{nameOf(path)};
+
+    for (const std::string &glob : globs) {
+      if (matchGlob(glob, path) || matchGlob(glob, name)) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+};
+
+// Compiled in main from the --include and --exclude patterns.
+PathMatcher path_matcher{};
+
+/*
+Runs tasks on a fixed set of worker threads. Each worker has its own deque
+and takes tasks from its back, idle workers steal from the front of the other
+workers' deques. Tasks submitted from a worker go to that worker's deque.
+*/
+class ThreadPool {
+public:
+  explicit ThreadPool(unsigned thread_count) {
+    for (unsigned i = 0; i < thread_count; i++) {
+      queues.push_back(std::make_unique<WorkQueue>());
+    }
+
+    for (unsigned i = 0; i < thread_count; i++) {
+      threads.emplace_back([this, i] { work(i); });
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+
+    task_condition.notify_all();
+
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+  }
+
+  void submit(std::function<void()> task) {
+    size_t index{current_pool == this
+                     ? current_index
+                     : next_queue.fetch_add(1) % queues.size()};
+
+    pending++;
+
+    {
+      std::lock_guard<std::mutex> lock(queues[index]->mutex);
+      queues[index]->tasks.push_back(std::move(task));
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queued++;
+    }
+
+    task_condition.notify_one();
+  }
+
+  // Blocks until every submitted task, including tasks they submit, is done.
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    done_condition.wait(lock, [this] { return pending == 0; });
+  }
+
+private:
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::unique_ptr<WorkQueue>> queues{};
+  std::vector<std::thread> threads{};
+  std::mutex mutex{};
+  std::condition_variable task_condition{};
+  std::condition_variable done_condition{};
+  std::atomic<size_t> next_queue{};
+  std::atomic<size_t> queued{};
+  std::atomic<size_t> pending{};
+  bool stopping{false};
+
+  static thread_local ThreadPool *current_pool;
+  static thread_local size_t current_index;
+
+  bool popTask(size_t index, std::function<void()> &task) {
+    for (size_t i = 0; i < queues.size(); i++) {
+      WorkQueue &queue{*queues[(index + i) % queues.size()]};
+      std::lock_guard<std::mutex> lock(queue.mutex);
+
+      if (queue.tasks.empty()) {
+        continue;
+      }
+
+      // own work is taken newest first, stolen work oldest first
+      if (i == 0) {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      } else {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+      }
+
+      queued--;
+
+      return true;
+    }
+
+    return false;
+  }
+
+  void work(size_t index) {
+    current_pool = this;
+    current_index = index;
+
+    std::function<void()> task{};
+
+    while (true) {
+      if (popTask(index, task)) {
+        task();
+        task = nullptr;
+
+        if (--pending == 0) {
+          std::lock_guard<std::mutex> lock(mutex);
+          done_condition.notify_all();
+        }
+
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(mutex);
+      task_condition.wait(lock, [this] { return stopping || queued > 0; });
+
+      if (stopping && queued == 0) {
+        return;
+      }
+    }
+  }
+};
+
+thread_local ThreadPool *ThreadPool::current_pool{};
+thread_local size_t ThreadPool::current_index{};
+
+/*
+A FIFO queue holding at most capacity items. push blocks while the queue is
+full, pop blocks while it is empty, so a slow consumer throttles its producers.
+*/
+template <typename T> class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t queue_capacity) : capacity{queue_capacity} {}
+
+  // Returns false without queueing item if the queue has been closed.
+  bool push(T item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+
+    if (closed) {
+      return false;
+    }
+
+    items.push_back(std::move(item));
+    lock.unlock();
+    not_empty.notify_one();
+
+    return true;
+  }
+
+  // Like pop, but returns false instead of blocking while the queue is empty.
+  bool tryPop(T &item) {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if (items.empty()) {
+      return false;
+    }
+
+    item = std::move(items.front());
+    items.pop_front();
+    lock.unlock();
+    not_full.notify_one();
+
+    return true;
+  }
+
+  // Returns false once the queue has been closed and all items were popped.
+  bool pop(T &item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_empty.wait(lock, [this] { return closed || !items.empty(); });
+
+    if (items.empty()) {
+      return false;
+    }
+
+    item = std::move(items.front());
+    items.pop_front();
+    lock.unlock();
+    not_full.notify_one();
+
+    return true;
+  }
+
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+    }
+
+    not_full.notify_all();
+    not_empty.notify_all();
+  }
+
+private:
+  const size_t capacity;
+  std::deque<T> items{};
+  std::mutex mutex{};
+  std::condition_variable not_full{};
+  std::condition_variable not_empty{};
+  bool closed{false};
+};
+
+// Number of files read together by readFileBatch.
+const unsigned IO_URING_ENTRIES{64};
+
+// Number of files each pipeline stage may have waiting per job.
+const size_t QUEUE_DEPTH_PER_JOB{4};
+
+/*
+State shared by the stages of one randomize run. Files flow from the walker
+through the read, rewrite and commit queues, each of which is bounded so the
+number of files in flight stays constant however large the tree is.
+*/
+struct RandomizeRun {
+  RandomizeRun(unsigned thread_count, RunMode run_mode)
+      : mode{run_mode},
+        read_queue(use_io_uring
+                       ? std::max<size_t>(thread_count * QUEUE_DEPTH_PER_JOB,
+                                          IO_URING_ENTRIES)
+                       : thread_count * QUEUE_DEPTH_PER_JOB),
+        rewrite_queue(thread_count * QUEUE_DEPTH_PER_JOB),
+        commit_queue(thread_count * QUEUE_DEPTH_PER_JOB),
+        thread_pool(thread_count) {}
+
+  const RunMode mode;
+  // filled by the committer in INDEX mode
+  ProjectIndex *project_index{};
+  UIDCache *cache{};
+  const GodotUIDCache *godot_uid_cache{};
+  size_t cached_files{};
+  size_t indexed_files{};
+  size_t malformed_uids{};
+  size_t rewritten_files{};
+  size_t skipped_files{};
+  // directories listed in Godot's editor cache, see loadEditorCache
+  std::set<std::filesystem::path> editor_cache_directories{};
+  BoundedQueue<std::unique_ptr<FileJob>> read_queue;
+  BoundedQueue<std::unique_ptr<FileJob>> rewrite_queue;
+  BoundedQueue<std::unique_ptr<FileJob>> commit_queue;
+  std::atomic<size_t> next_sequence{};
+  std::atomic<bool> failed{false};
+
+  // walks directories, declared last so it is joined before the queues go away
+  ThreadPool thread_pool;
+};
+
+// Queues file_path for reading, blocking while the read queue is full.
+void submitFile(RandomizeRun &run, std::filesystem::path file_path) {
+  auto job{std::make_unique<FileJob>()};
+  job->mode = run.mode;
+  job->project_index = run.project_index;
+  job->cache = run.cache;
+  job->godot_uid_cache = run.godot_uid_cache;
+  job->sequence = run.next_sequence++;
+  job->file_path = std::move(file_path);
+  // only declarations are needed, and they are always in the header, while
+  // references can also be in the body, e.g. @export_file values
+  job->header_only = !full_scan &&
+                     (run.mode == RunMode::INDEX ||
+                      run.mode == RunMode::DUPLICATES) &&
+                     isTextResourcePath(job->file_path);
+
+  run.read_queue.push(std::move(job));
+}
+
+/*
+Calls readFile for each queued file and passes it on to the rewrite queue. If
+use_io_uring is enabled and io_uring is available, the queued files are read
+in batches with readFileBatch instead.
+*/
+void readStage(RandomizeRun &run) {
+  std::unique_ptr<FileJob> job{};
+  std::unique_ptr<IOUring> ring{};
+
+  if (use_io_uring) {
+    ring = std::make_unique<IOUring>(IO_URING_ENTRIES);
+
+    if (!ring->isValid()) {
+      ring.reset();
+    }
+  }
+
+  std::vector<std::unique_ptr<FileJob>> batch{};
+  std::vector<FileJob *> batch_jobs{};
+
+  while (run.read_queue.pop(job)) {
+    batch.push_back(std::move(job));
+
+    // takes whatever else is queued without waiting for more
+    while (ring && batch.size() < ring->size() && run.read_queue.tryPop(job)) {
+      batch.push_back(std::move(job));
+    }
+
+    if (!run.failed && ring) {
+      for (std::unique_ptr<FileJob> &batch_job : batch) {
+        batch_jobs.push_back(batch_job.get());
+      }
+
+      if (!readFileBatch(*ring, batch_jobs)) {
+        ring.reset();
+      }
+
+      batch_jobs.clear();
+    } else if (!run.failed) {
+      readFile(*batch.front());
+    }
+
+    for (std::unique_ptr<FileJob> &batch_job : batch) {
+      run.rewrite_queue.push(std::move(batch_job));
+    }
+
+    batch.clear();
+  }
+}
+
+// Calls rewriteJob for each read file and passes it on to the commit queue.
+void rewriteStage(RandomizeRun &run) {
+  std::unique_ptr<FileJob> job{};
+
+  while (run.rewrite_queue.pop(job)) {
+    if (!run.failed && job->succeeded) {
+      rewriteJob(*job);
+    }
+
+    if (!job->succeeded) {
+      run.failed = true;
+    }
+
+    run.commit_queue.push(std::move(job));
+  }
+}
+
+/*
+Adds the UIDs declared by a file to the project index and records which files
+declare a UID that another file already declares. Of two files declaring the
+same UID the one with the lower path keeps it, unless keep_existing is set, in
+which case the file added first keeps it.
+*/
+void indexDeclarations(ProjectIndex &project_index,
+                       const std::filesystem::path &file_path,
+                       const std::vector<uint64_t> &declared_uids,
+                       bool keep_existing = false) {
+  if (declared_uids.empty()) {
+    return;
+  }
+
+  uint32_t file_index{
+      static_cast<uint32_t>(project_index.declaring_files.size())};
+  project_index.declaring_files.push_back(file_path);
+
+  if (project_index.keep_file_uids) {
+    project_index.file_uids.push_back(declared_uids);
+  }
+
+  for (uint64_t uid : declared_uids) {
+    uint32_t *owner{project_index.uid_index.insert(uid, file_index)};
+
+    if (*owner == file_index) {
+      continue;
+    }
+
+    uint32_t duplicate{file_index};
+
+    if (!keep_existing && file_path < project_index.declaring_files[*owner]) {
+      duplicate = *owner;
+      *owner = file_index;
+    }
+
+    project_index.duplicates.push_back({uid, duplicate});
+  }
+}
+
+// Staged files are journaled and synced in batches of this many files.
+const size_t STAGE_BATCH_SIZE{64};
+
+/*
+Syncs the names of the files in staged_files to the journal, then links each
+with stageFile. Once a file fails the rest are dropped from the journal
+unless openTempfile created their <name>.tmp, which rollBack then removes.
+*/
+void stageFiles(RandomizeRun &run, UndoJournal &journal,
+                std::vector<StagedFile> &staged_files) {
+  if (!run.failed && !journal.sync()) {
+    std::cout << "ERROR: Unable to write " << JOURNAL_PATH.string() << '\n';
+    run.failed = true;
+  }
+
+  for (StagedFile &staged_file : staged_files) {
+    if (!run.failed && stageFile(staged_file, std::cout)) {
+      continue;
+    }
+
+    if (staged_file.tempfile_descriptor >= 0) {
+      close(staged_file.tempfile_descriptor);
+    }
+
+    if (staged_file.tempfile_path.empty()) {
+      journal.unstage(staged_file.file_path);
+    }
+
+    run.failed = true;
+  }
+
+  staged_files.clear();
+}
+
+/*
+Lists each rewritten or patched file in the journal and stages rewritten
+files with stageFiles, or calls indexDeclarations for each indexed file, and
+prints the log of each file once the logs of all files submitted before it
+have been printed. Indexed files are only logged verbosely or on errors. Once
+every file has been staged they are committed together with
+commitTransaction. If a file failed no further files are staged and the
+journal is rolled back, leaving every file as it was.
+*/
+void commitStage(RandomizeRun &run) {
+  std::unique_ptr<FileJob> job{};
+  std::map<size_t, std::string> finished_logs{};
+  UndoJournal journal{};
+  std::vector<StagedFile> staged_files{};
+  size_t next_log{};
+
+  while (run.commit_queue.pop(job)) {
+    bool changed{job->tempfile_descriptor >= 0 || !job->patches.empty()};
+
+    if (!run.failed && changed && !journal.isOpen() &&
+        !journal.begin()) {
+      std::cout << "ERROR: Unable to write " << JOURNAL_PATH.string() << '\n';
+      run.failed = true;
+    }
+
+    if (run.failed) {
+      if (job->tempfile_descriptor >= 0) {
+        close(job->tempfile_descriptor);
+      }
+
+      if (!job->tempfile_path.empty()) {
+        std::remove(job->tempfile_path.c_str());
+      }
+    } else if (run.mode == RunMode::INDEX) {
+      indexDeclarations(*run.project_index, job->file_path,
+                        job->declared_uids);
+      run.indexed_files++;
+      run.cached_files += job->cached;
+
+      if (run.cache && job->succeeded) {
+        run.cache->record(job->file_path, job->file_status,
+                          job->declared_uids, job->malformed_uids);
+      }
+
+      run.malformed_uids += job->malformed_uids;
+
+      if (!verbose && job->succeeded && job->malformed_uids == 0) {
+        job->output.str("");
+      }
+    } else if (job->skipped) {
+      run.skipped_files++;
+    } else if (!job->patches.empty()) {
+      journal.patch(job->file_path, job->patches);
+    } else if (job->tempfile_descriptor >= 0) {
+      journal.stage(job->file_path);
+      staged_files.push_back({job->file_path, job->tempfile_descriptor,
+                              job->tempfile_path});
+      job->tempfile_descriptor = -1;
+
+      if (staged_files.size() == STAGE_BATCH_SIZE) {
+        stageFiles(run, journal, staged_files);
+      }
+    } else {
+      run.rewritten_files += job->succeeded;
+    }
+
+    finished_logs.emplace(job->sequence, job->output.str());
+
+    for (auto log{finished_logs.begin()};
+         log != finished_logs.end() && log->first == next_log;
+         log = finished_logs.erase(log), next_log++) {
+      std::cout << log->second;
+    }
+  }
+
+  if (!journal.isOpen()) {
+    return;
+  }
+
+  stageFiles(run, journal, staged_files);
+
+  if (run.failed) {
+    journal.rollBack(0);
+  } else if (commitTransaction(journal, std::cout)) {
+    run.rewritten_files += journal.records().staged_files.size() +
+                           journal.records().patched_files.size();
+  } else {
+    run.failed = true;
+  }
+}
+
+/*
+Checks if a directory is left out of the walk before its entries are read, as
+Godot's own file system scan does: hidden directories such as .godot and .git,
+directories holding a .gdignore file and directories matching --exclude.
+*/
+bool isPrunedDirectory(const std::filesystem::path &directory) {
+  std::string name{directory.filename().string()};
+
+  return (name.size() > 1 && name[0] == '.' && name != "..") ||
+         access((directory / ".gdignore").c_str(), F_OK) == 0 ||
+         path_matcher.excludes(directory);
+}
+
+void walkDirectory(
+    RandomizeRun &run, const std::filesystem::path &directory,
+    const std::set<std::filesystem::path> *known_directories = nullptr);
+
+/*
+Uses the entry type reported by readdir to decide what entry is, so only
+symbolic links and file systems that don't report types need a stat. Files
+with a valid extension that aren't excluded are submitted with submitFile,
+subdirectories are walked on the thread pool if recursive iteration is enabled
+and isPrunedDirectory doesn't prune them. Subdirectories in known_directories
+are skipped, as they are handled separately. Like
+std::filesystem::recursive_directory_iterator, symbolic links to directories
+are not followed.
+*/
+void handleDirectoryEntry(
+    RandomizeRun &run, int directory_descriptor,
+    const std::filesystem::path &directory, const dirent &entry,
+    const std::set<std::filesystem::path> *known_directories) {
+  std::string_view name{entry.d_name};
+
+  if (name == "." || name == "..") {
+    return;
+  }
+
+  bool is_directory{entry.d_type == DT_DIR};
+  bool is_regular_file{entry.d_type == DT_REG};
+
+  if (entry.d_type == DT_UNKNOWN || entry.d_type == DT_LNK) {
+    struct stat entry_status{};
+
+    if (fstatat(directory_descriptor, entry.d_name, &entry_status, 0) != 0) {
+      return;
+    }
+
+    is_directory = entry.d_type == DT_UNKNOWN && S_ISDIR(entry_status.st_mode);
+    is_regular_file = S_ISREG(entry_status.st_mode);
+  }
+
+  if (is_directory && recursive) {
+    std::filesystem::path subdirectory{directory / entry.d_name};
+
+    if (!isPrunedDirectory(subdirectory) &&
+        !(known_directories && known_directories->count(subdirectory))) {
+      run.thread_pool.submit([&run, subdirectory = std::move(subdirectory)] {
+        walkDirectory(run, subdirectory);
+      });
+    }
+  } else if (is_regular_file) {
+    std::filesystem::path file_path{directory / entry.d_name};
+
+    if (path_matcher.selects(file_path) && !path_matcher.excludes(file_path)) {
+      submitFile(run, std::move(file_path));
+    }
+  }
+}
+
+// Reads a directory with readdir and calls handleDirectoryEntry for each entry.
+void walkDirectory(RandomizeRun &run, const std::filesystem::path &directory,
+                   const std::set<std::filesystem::path> *known_directories) {
+  if (run.failed) {
+    return;
+  }
+
+  DIR *directory_stream{opendir(directory.c_str())};
+
+  if (!directory_stream) {
+    return;
+  }
+
+  int directory_descriptor{dirfd(directory_stream)};
+
+  while (const dirent *entry{readdir(directory_stream)}) {
+    handleDirectoryEntry(run, directory_descriptor, directory, *entry,
+                         known_directories);
+  }
+
+  closedir(directory_stream);
+}
+
+void printRandomizingMessage(bool files = false,
+                             std::string_view action = "Randomizing") {
+  if (files) {
+    std::cout << action << " UIDS of all godot file(s) listed";
+  } else {
+    std::cout << action << " UIDS of all godot files in current directory";
+
+    if (recursive) {
+      std::cout << " and all subdirectories";
+    }
+  }
+
+  std::cout << "...\n";
+}
+
+/*
+Walks the current directory and if recursive iteration is enabled, its
+subdirectories in parallel. Files are queued as soon as they are found.
+*/
+void randomizeDirectory(RandomizeRun &run) {
+  run.thread_pool.submit([&run] { walkDirectory(run, "."); });
+}
+
+/*
+Runs each file in paths, or each file found by randomizeDirectory if directory
+iteration is enabled, through a pipeline of jobs reader threads, jobs rewriter
+threads and one committer thread. Files are rewritten while the directory walk
+is still running. Unless indexing, prints how many files were rewritten and
+how many were skipped because they had no UIDs to replace.
+*/
+bool runPipeline(RandomizeRun &run, bool directory,
+                 const std::vector<std::filesystem::path> &paths) {
+  std::vector<std::thread> stage_threads{};
+
+  // each stage closes the queue after it once all of its threads are done
+  auto startStage{[&](size_t thread_count, void (*stage)(RandomizeRun &),
+                      BoundedQueue<std::unique_ptr<FileJob>> *next_queue) {
+    auto remaining{std::make_shared<std::atomic<size_t>>(thread_count)};
+
+    for (size_t i = 0; i < thread_count; i++) {
+      stage_threads.emplace_back([&run, stage, next_queue, remaining] {
+        stage(run);
+
+        if (--*remaining == 0 && next_queue) {
+          next_queue->close();
+        }
+      });
+    }
+  }};
+
+  startStage(jobs, readStage, &run.rewrite_queue);
+  startStage(jobs, rewriteStage, &run.commit_queue);
+  startStage(1, commitStage, nullptr);
+
+  if (directory) {
+    randomizeDirectory(run);
+  } else {
+    for (const std::filesystem::path &file_path : paths) {
+      if (path_matcher.selects(file_path)) {
+        submitFile(run, file_path);
+      }
+    }
+  }
+
+  run.thread_pool.wait();
+  run.read_queue.close();
+
+  for (std::thread &stage_thread : stage_threads) {
+    stage_thread.join();
+  }
+
+  if (run.mode != RunMode::INDEX) {
+    std::cout << "Rewrote " << run.rewritten_files << " file(s), skipped "
+              << run.skipped_files << " file(s) without UIDs.\n";
+  }
+
+  return !run.failed;
+}
+
+// Godot's editor caches, relative to the project root.
+const std::filesystem::path EDITOR_CACHE_DIRECTORY{".godot/editor"};
+const std::string_view EDITOR_CACHE_PREFIX{"filesystem_cache"};
+
+/*
+Returns the filesystem_cache file with the highest format version in
+EDITOR_CACHE_DIRECTORY, or an empty path if there is none.
+*/
+std::filesystem::path findEditorCache() {
+  std::filesystem::path newest_path{};
+  unsigned long newest_version{};
+  std::error_code error_code{};
+
+  for (const std::filesystem::directory_entry &entry :
+       std::filesystem::directory_iterator(EDITOR_CACHE_DIRECTORY,
+                                           error_code)) {
+    std::string name{entry.path().filename().string()};
+
+    if (name.compare(0, EDITOR_CACHE_PREFIX.size(), EDITOR_CACHE_PREFIX) != 0) {
+      continue;
+    }
+
+    unsigned long version{
+        std::strtoul(name.c_str() + EDITOR_CACHE_PREFIX.size(), nullptr, 10)};
+
+    if (newest_path.empty() || version > newest_version) {
+      newest_path = entry.path();
+      newest_version = version;
+    }
+  }
+
+  return newest_path;
+}
+
+/*
+Splits a line of the editor cache at "::" into at most count fields and
+returns the number of fields found. The last field holds the rest of the line.
+*/
+size_t splitEditorCacheLine(std::string_view line, std::string_view *fields,
+                            size_t count) {
+  size_t found{};
+
+  while (found + 1 < count) {
+    size_t separator{line.find("::")};
+
+    if (separator == std::string_view::npos) {
+      break;
+    }
+
+    fields[found++] = line.substr(0, separator);
+    line.remove_prefix(separator + 2);
+  }
+
+  fields[found++] = line;
+
+  return found;
+}
+
+// Parses a decimal field of the editor cache, 0 if it isn't a number.
+long long parseEditorCacheNumber(std::string_view field) {
+  long long number{};
+  std::from_chars(field.data(), field.data() + field.size(), number);
+
+  return number;
+}
+
+/*
+Indexes the files listed in Godot's editor filesystem cache without opening
+them. The cache lists each directory as "::res://path/::mtime", followed by a
+line "name::type::uid::mtime::import_mtime::..." per file, where uid is the
+ResourceUID integer decodeUID gives for the same text, or -1 for files without
+one, so cached files and files that are read share one index. An imported
+file's UID lives in its .import file, so that is the file indexed, checked
+against import_mtime. Files whose modification time disagrees with the cache
+are added to paths to be read, as are .uid files, whose times Godot doesn't
+record. Directories whose modification time disagrees may have gained or lost
+files, so they are walked on the thread pool, descending only into
+subdirectories the cache doesn't list. Returns false if there is no editor
+cache.
+*/
+bool loadEditorCache(RandomizeRun &run,
+                     std::vector<std::filesystem::path> &paths,
+                     size_t &editor_cache_files) {
+  std::filesystem::path cache_path{findEditorCache()};
+  int descriptor{cache_path.empty()
+                     ? -1
+                     : open(cache_path.c_str(), O_RDONLY | O_CLOEXEC)};
+  struct stat cache_status{};
+
+  if (descriptor < 0 || fstat(descriptor, &cache_status) != 0) {
+    if (descriptor >= 0) {
+      close(descriptor);
+    }
+
+    return false;
+  }
+
+  MappedFile mapped_cache(descriptor, cache_status.st_size);
+  close(descriptor);
+
+  std::string_view cache{mapped_cache.view()};
+  std::set<std::filesystem::path> &directories{run.editor_cache_directories};
+  std::set<std::filesystem::path> pruned_directories{};
+  std::vector<std::filesystem::path> stale_directories{};
+  std::filesystem::path directory{};
+  // false while the lines belong to a pruned or stale directory
+  bool directory_fresh{false};
+  struct stat file_status{};
+
+  // the first line holds the version of Godot's import settings
+  size_t line_start{cache.find('\n')};
+
+  while (line_start < cache.size()) {
+    size_t line_end{cache.find('\n', ++line_start)};
+    std::string_view line{cache.substr(line_start, line_end - line_start)};
+    line_start = line_end;
+
+    std::string_view fields[5]{};
+    size_t field_count{splitEditorCacheLine(line, fields, 5)};
+
+    if (field_count == 3 && fields[0].empty()) {
+      std::string_view resource_path{fields[1]};
+
+      if (resource_path.compare(0, 6, "res://") != 0) {
+        directory_fresh = false;
+
+        continue;
+      }
+
+      resource_path.remove_prefix(6);
+
+      if (!resource_path.empty() && resource_path.back() == '/') {
+        resource_path.remove_suffix(1);
+      }
+
+      directory = resource_path.empty()
+                      ? std::filesystem::path{"."}
+                      : std::filesystem::path{"."} / resource_path;
+      directories.insert(directory);
+
+      bool root{directory == "."};
+      directory_fresh = false;
+
+      if (!root && (!recursive ||
+                    pruned_directories.count(directory.parent_path()) ||
+                    isPrunedDirectory(directory))) {
+        pruned_directories.insert(directory);
+      } else if (stat(directory.c_str(), &file_status) != 0) {
+        pruned_directories.insert(directory);
+      } else if (file_status.st_mtime != parseEditorCacheNumber(fields[2])) {
+        stale_directories.push_back(directory);
+      } else {
+        directory_fresh = true;
+      }
+
+      continue;
+    }
+
+    if (!directory_fresh || field_count < 5) {
+      continue;
+    }
+
+    std::filesystem::path file_path{directory / fields[0]};
+    long long import_time{parseEditorCacheNumber(fields[4])};
+    long long expected_time{parseEditorCacheNumber(fields[3])};
+
+    if (import_time != 0) {
+      file_path += ".import";
+      expected_time = import_time;
+    } else if (!path_matcher.selects(file_path)) {
+      file_path += ".uid";
+
+      if (path_matcher.selects(file_path) &&
+          !path_matcher.excludes(file_path) &&
+          access(file_path.c_str(), F_OK) == 0) {
+        paths.push_back(std::move(file_path));
+      }
+
+      continue;
+    }
+
+    if (!path_matcher.selects(file_path) || path_matcher.excludes(file_path) ||
+        stat(file_path.c_str(), &file_status) != 0) {
+      continue;
+    }
+
+    if (file_status.st_mtime != expected_time) {
+      paths.push_back(std::move(file_path));
+
+      continue;
+    }
+
+    std::vector<uint64_t> declared_uids{};
+    long long uid{parseEditorCacheNumber(fields[2])};
+
+    if (uid >= 0) {
+      declared_uids.push_back(uid);
+    }
+
+    indexDeclarations(*run.project_index, file_path, declared_uids);
+    run.indexed_files++;
+    editor_cache_files++;
+  }
+
+  for (std::filesystem::path &stale_directory : stale_directories) {
+    run.thread_pool.submit([&run, stale_directory] {
+      walkDirectory(run, stale_directory, &run.editor_cache_directories);
+    });
+  }
+
+  return true;
+}
+
+/*
+Runs the INDEX pass over file_paths or the current directory. If use_cache is
+enabled files unchanged since the last run are indexed from the cache and the
+cache is rewritten afterwards. If use_godot_uid_cache is enabled files older
+than Godot's uid_cache.bin take their UIDs from it. If use_editor_cache is
+enabled the directory is not walked, the files unchanged since Godot last
+scanned the project are indexed from its editor cache by loadEditorCache. The
+number of malformed UIDs found is stored in malformed_uids if given.
+*/
+bool indexProject(ProjectIndex &project_index, bool directory,
+                  size_t *malformed_uids = nullptr) {
+  std::unique_ptr<UIDCache> cache{};
+
+  if (use_cache) {
+    cache = std::make_unique<UIDCache>(CACHE_FILE_NAME);
+  }
+
+  std::unique_ptr<GodotUIDCache> godot_uid_cache{};
+
+  if (use_godot_uid_cache) {
+    godot_uid_cache = std::make_unique<GodotUIDCache>(GODOT_UID_CACHE_PATH);
+
+    if (!godot_uid_cache->isValid()) {
+      std::cout << "WARNING: Unable to read " << GODOT_UID_CACHE_PATH.string()
+                << ", reading every file instead.\n";
+      godot_uid_cache.reset();
+    }
+  }
+
+  RandomizeRun run(jobs, RunMode::INDEX);
+  run.project_index = &project_index;
+  run.cache = cache.get();
+  run.godot_uid_cache = godot_uid_cache.get();
+
+  printRandomizingMessage(!directory, check ? "Checking" : "Indexing");
+
+  std::vector<std::filesystem::path> paths{file_paths};
+  size_t editor_cache_files{};
+  bool walk{directory};
+
+  if (directory && use_editor_cache) {
+    walk = !loadEditorCache(run, paths, editor_cache_files);
+
+    if (walk) {
+      std::cout << "WARNING: No editor cache in "
+                << EDITOR_CACHE_DIRECTORY.string()
+                << ", walking the directory instead.\n";
+    }
+  }
+
+  if (!runPipeline(run, walk, paths)) {
+    return false;
+  }
+
+  if (malformed_uids) {
+    *malformed_uids = run.malformed_uids;
+  }
+
+  std::cout << "Indexed " << run.indexed_files << " file(s)";
+
+  if (use_editor_cache) {
+    std::cout << ", " << editor_cache_files << " from Godot's editor cache";
+  }
+
+  if (cache || godot_uid_cache) {
+    std::cout << ", " << run.cached_files << " from the cache";
+  }
+
+  if (cache) {
+    if (!cache->save()) {
+      std::cout << " (WARNING: Unable to write " << CACHE_FILE_NAME << ")";
+    }
+  }
+
+  std::cout << ".\n";
+
+  return true;
+}
+
+/*
+Randomizes only the declarations of the files in project_index whose UIDs
+collide with another file's, so every other file is left untouched.
+*/
+bool randomizeDuplicates(ProjectIndex &project_index) {
+  std::vector<uint32_t> duplicate_files{};
+
+  for (const DuplicateUID &duplicate : project_index.duplicates) {
+    duplicate_files.push_back(duplicate.file_index);
+  }
+
+  std::sort(duplicate_files.begin(), duplicate_files.end());
+  duplicate_files.erase(
+      std::unique(duplicate_files.begin(), duplicate_files.end()),
+      duplicate_files.end());
+
+  std::cout << "Found " << project_index.duplicates.size()
+            << " duplicate UID(s) in " << duplicate_files.size()
+            << " file(s).\n";
+
+  if (duplicate_files.empty()) {
+    return true;
+  }
+
+  std::vector<std::filesystem::path> paths{};
+
+  for (uint32_t file_index : duplicate_files) {
+    paths.push_back(project_index.declaring_files[file_index]);
+  }
+
+  RandomizeRun run(jobs, RunMode::DUPLICATES);
+  std::cout << "Randomizing duplicate UIDS...\n";
+
+  return runPipeline(run, false, paths);
+}
+
+// Indexes the UIDs declared by every file, then calls randomizeDuplicates.
+bool fixDuplicates(bool directory) {
+  ProjectIndex project_index{};
+
+  if (!indexProject(project_index, directory)) {
+    return false;
+  }
+
+  return randomizeDuplicates(project_index);
+}
+
+/*
+Indexes the UIDs declared by every file and generates a new UID for each, then
+replaces every declaration and every reference to a declared UID in all files
+in one parallel pass, so references keep pointing at the same resources.
+Files that declare a UID owned by another file get a UID of their own.
+*/
+bool remapUIDs(bool directory) {
+  ProjectIndex project_index{};
+
+  if (!indexProject(project_index, directory)) {
+    return false;
+  }
+
+  // remapped UIDs keep the length of their text form for in place patching
+  std::vector<uint64_t> new_uids(project_index.uid_index.size());
+  size_t next_uid{};
+
+  if (!in_place) {
+    uid_generator.generateBatch(new_uids.data(), new_uids.size());
+  }
+
+  project_index.uid_index.forEach([&](uint64_t uid, uint32_t) {
+    project_index.remapped_uids.insert(
+        uid, in_place ? uid_generator.nextUID(encodedUIDLength(uid))
+                      : new_uids[next_uid++]);
+  });
+
+  RandomizeRun run(jobs, RunMode::REMAP);
+  run.project_index = &project_index;
+
+  printRandomizingMessage(!directory, "Remapping");
+
+  return runPipeline(run, directory, file_paths);
+}
+
+// Time without further events after which a batch of changes is handled.
+const int WATCH_DEBOUNCE_MILLISECONDS{250};
+
+const uint32_t WATCH_EVENTS{IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                            IN_CREATE | IN_DELETE | IN_ONLYDIR};
+
+/*
+Watches directories with inotify and collects the supported files created,
+changed, moved or deleted in them. Directories created while watching are
+watched as well if recursive iteration is enabled.
+*/
+class DirectoryWatcher {
+public:
+  DirectoryWatcher() : descriptor{inotify_init1(IN_NONBLOCK | IN_CLOEXEC)} {}
+
+  DirectoryWatcher(const DirectoryWatcher &) = delete;
+  DirectoryWatcher &operator=(const DirectoryWatcher &) = delete;
+
+  ~DirectoryWatcher() {
+    if (descriptor >= 0) {
+      close(descriptor);
+    }
+  }
+
+  bool isValid() const { return descriptor >= 0; }
+
+  /*
+  Watches directory and if recursive iteration is enabled its subdirectories
+  that isPrunedDirectory doesn't prune. If report_files is set the supported
+  files already in them count as changed, as they may have been written before
+  the watch was added.
+  */
+  void watch(const std::filesystem::path &directory, bool report_files) {
+    int watch_descriptor{
+        inotify_add_watch(descriptor, directory.c_str(), WATCH_EVENTS)};
+
+    if (watch_descriptor < 0) {
+      return;
+    }
+
+    directories[watch_descriptor] = directory;
+
+    DIR *directory_stream{opendir(directory.c_str())};
+
+    if (!directory_stream) {
+      return;
+    }
+
+    while (const dirent *entry{readdir(directory_stream)}) {
+      std::string_view name{entry->d_name};
+      std::filesystem::path entry_path{directory / entry->d_name};
+
+      if (name == "." || name == "..") {
+        continue;
+      }
+
+      if (entry->d_type == DT_DIR ||
+          (entry->d_type == DT_UNKNOWN &&
+           std::filesystem::is_directory(entry_path))) {
+        if (recursive && !isPrunedDirectory(entry_path)) {
+          watch(entry_path, report_files);
+        }
+      } else if (report_files && path_matcher.selects(entry_path) &&
+                 !path_matcher.excludes(entry_path)) {
+        changed_files.insert(entry_path);
+      }
+    }
+
+    closedir(directory_stream);
+  }
+
+  /*
+  Blocks until a watched file changes, then keeps collecting events until none
+  arrive for WATCH_DEBOUNCE_MILLISECONDS, so a checkout touching thousands of
+  files is handled as one batch. Returns the changed files. If the kernel's
+  event queue overflowed, changes were lost and overflowed is set instead.
+  */
+  std::set<std::filesystem::path> waitForChanges(bool &overflowed) {
+    pollfd poll_descriptor{descriptor, POLLIN, 0};
+
+    while (changed_files.empty() && !queue_overflowed) {
+      if (poll(&poll_descriptor, 1, -1) > 0) {
+        readEvents();
+      }
+    }
+
+    while (poll(&poll_descriptor, 1, WATCH_DEBOUNCE_MILLISECONDS) > 0) {
+      readEvents();
+    }
+
+    overflowed = queue_overflowed;
+    queue_overflowed = false;
+
+    if (overflowed) {
+      changed_files.clear();
+    }
+
+    return std::move(changed_files);
+  }
+
+private:
+  int descriptor;
+  std::unordered_map<int, std::filesystem::path> directories{};
+  std::set<std::filesystem::path> changed_files{};
+  // set by an IN_Q_OVERFLOW event, which has no watch descriptor
+  bool queue_overflowed{false};
+
+  // Reads all pending events without blocking.
+  void readEvents() {
+    alignas(inotify_event) char buffer[16384];
+    ssize_t length{};
+
+    while ((length = read(descriptor, buffer, sizeof(buffer))) > 0) {
+      for (ssize_t offset = 0; offset < length;) {
+        const auto *event{reinterpret_cast<const inotify_event *>(buffer +
+                                                                  offset)};
+        offset += sizeof(inotify_event) + event->len;
+
+        if (event->mask & IN_Q_OVERFLOW) {
+          queue_overflowed = true;
+
+          continue;
+        }
+
+        auto directory{directories.find(event->wd)};
+
+        if (directory == directories.end()) {
+          continue;
+        }
+
+        if (event->mask & IN_IGNORED) {
+          directories.erase(directory);
+
+          continue;
+        }
+
+        if (event->len == 0) {
+          continue;
+        }
+
+        std::filesystem::path entry_path{directory->second / event->name};
+
+        if (event->mask & IN_ISDIR) {
+          if (recursive && event->mask & (IN_CREATE | IN_MOVED_TO) &&
+              !isPrunedDirectory(entry_path)) {
+            watch(entry_path, true);
+          }
+        } else if (path_matcher.selects(entry_path) &&
+                   !path_matcher.excludes(entry_path)) {
+          changed_files.insert(entry_path);
+        }
+      }
+    }
+  }
+};
+
+/*
+Watches the directory tree with watcher, indexes all of it into declarations,
+replacing what they held, and fixes duplicate UIDs like fixDuplicates. The
+tree is watched before it is indexed so no change made meanwhile is lost.
+*/
+bool indexWatchedDirectory(
+    DirectoryWatcher &watcher,
+    std::map<std::filesystem::path, std::vector<uint64_t>> &declarations) {
+  watcher.watch(".", false);
+
+  ProjectIndex project_index{};
+  project_index.keep_file_uids = true;
+
+  if (!indexProject(project_index, true)) {
+    return false;
+  }
+
+  declarations.clear();
+
+  for (size_t i = 0; i < project_index.declaring_files.size(); i++) {
+    declarations[project_index.declaring_files[i]] =
+        std::move(project_index.file_uids[i]);
+  }
+
+  return randomizeDuplicates(project_index);
+}
+
+/*
+Fixes duplicate UIDs like fixDuplicates, then keeps the declared UIDs of every
+file in memory and watches the directory tree for changes. Each batch of
+changed files is indexed again and merged into the resident index, and a
+changed file that now declares a UID another file already declares gets a new
+one. If the kernel dropped events because its queue overflowed, the whole tree
+is indexed again instead. Runs until the process is interrupted.
+*/
+bool watchDirectory() {
+  DirectoryWatcher watcher{};
+
+  if (!watcher.isValid()) {
+    std::cout << "ERROR: Unable to watch current directory (inotify)\n";
+
+    return false;
+  }
+
+  std::map<std::filesystem::path, std::vector<uint64_t>> declarations{};
+
+  if (!indexWatchedDirectory(watcher, declarations)) {
+    return false;
+  }
+
+  while (true) {
+    std::cout << "Watching for changes...\n" << std::flush;
+
+    bool overflowed{false};
+    std::set<std::filesystem::path> changed_files{
+        watcher.waitForChanges(overflowed)};
+
+    if (overflowed) {
+      std::cout << "WARNING: Too many changes to track, rescanning all "
+                   "files...\n";
+      indexWatchedDirectory(watcher, declarations);
+
+      continue;
+    }
+    std::vector<std::filesystem::path> existing_files{};
+
+    for (const std::filesystem::path &file_path : changed_files) {
+      declarations.erase(file_path);
+
+      std::error_code error_code{};
+
+      if (std::filesystem::is_regular_file(file_path, error_code)) {
+        existing_files.push_back(file_path);
+      }
+    }
+
+    std::cout << "Rescanning " << changed_files.size()
+              << " changed file(s)...\n";
+
+    ProjectIndex changed_index{};
+    changed_index.keep_file_uids = true;
+    RandomizeRun run(jobs, RunMode::INDEX);
+    run.project_index = &changed_index;
+
+    // a file that vanished during the batch is picked up by the next one
+    runPipeline(run, false, existing_files);
+
+    for (size_t i = 0; i < changed_index.declaring_files.size(); i++) {
+      declarations[changed_index.declaring_files[i]] =
+          std::move(changed_index.file_uids[i]);
+    }
+
+    // unchanged files go first so they keep their UIDs
+    ProjectIndex resident_index{};
+
+    for (const auto &[file_path, uids] : declarations) {
+      if (!changed_files.count(file_path)) {
+        indexDeclarations(resident_index, file_path, uids);
+      }
+    }
+
+    for (const auto &[file_path, uids] : declarations) {
+      if (changed_files.count(file_path)) {
+        indexDeclarations(resident_index, file_path, uids, true);
+      }
+    }
+
+    randomizeDuplicates(resident_index);
+  }
+}
+
+/*
+Returns the text of the UID declared by the file at file_path that decodes to
+uid, as it is written in the file, so text that encodeUID wouldn't give back,
+such as UIDs with leading zero digits or too many digits, is reported the way
+it can be found. Binary resources and files that can't be read, or whose UIDs
+changed since they were indexed, fall back to encodeUID.
+*/
+std::string declaredUIDText(const std::filesystem::path &file_path,
+                            uint64_t uid) {
+  int descriptor{open(file_path.c_str(), O_RDONLY | O_CLOEXEC)};
+  struct stat file_status{};
+
+  if (descriptor < 0 || fstat(descriptor, &file_status) != 0 ||
+      !S_ISREG(file_status.st_mode) || isBinaryResourcePath(file_path)) {
+    if (descriptor >= 0) {
+      close(descriptor);
+    }
+
+    return encodeUID(uid);
+  }
+
+  MappedFile mapped_file(descriptor, file_status.st_size, false);
+  close(descriptor);
+
+  std::string_view buffer{mapped_file.view()};
+  std::vector<UIDSpan> spans{};
+  findUIDs(buffer, spans);
+
+  for (const UIDSpan &span : spans) {
+    std::string_view text{buffer.substr(span.offset, span.length)};
+
+    if (span.declaration && decodeUID(text) == uid) {
+      return std::string(text);
+    }
+  }
+
+  return encodeUID(uid);
+}
+
+/*
+Indexes every file without opening any of them for writing and reports each
+duplicate UID and every malformed UID found while indexing. Returns
+CHECK_FAILED if any were found, so it can gate merges in CI.
+*/
+int8_t checkUIDs(bool directory) {
+  ProjectIndex project_index{};
+  size_t malformed_uids{};
+
+  if (!indexProject(project_index, directory, &malformed_uids)) {
+    return FILE_OPEN_FAILED;
+  }
+
+  for (const DuplicateUID &duplicate : project_index.duplicates) {
+    const uint32_t *owner{project_index.uid_index.find(duplicate.uid)};
+    const std::filesystem::path &file_path{
+        project_index.declaring_files[duplicate.file_index]};
+    const std::filesystem::path &owner_path{
+        project_index.declaring_files[*owner]};
+    std::string text{declaredUIDText(file_path, duplicate.uid)};
+    std::string owner_text{declaredUIDText(owner_path, duplicate.uid)};
+
+    std::cout << "ERROR: Duplicate UID " << UID_PREFIX << text << " in "
+              << file_path.string() << " (also declared by "
+              << owner_path.string();
+
+    // different texts can decode to the same UID
+    if (owner_text != text) {
+      std::cout << " as " << UID_PREFIX << owner_text;
+    }
+
+    std::cout << ")\n";
+  }
+
+  std::cout << "Found " << project_index.duplicates.size()
+            << " duplicate UID(s) and " << malformed_uids
+            << " malformed UID(s).\n";
+
+  if (!project_index.duplicates.empty() || malformed_uids > 0) {
+    return CHECK_FAILED;
+  }
+
+  return SUCCESS;
+}
+
+/*
+Randomizes every UID in file_paths, or in every file found by
+randomizeDirectory if directory iteration is enabled. If duplicates_only,
+remap or watching is enabled calls fixDuplicates, remapUIDs or watchDirectory
+instead.
+*/
+bool randomize(bool directory = true) {
+  if (duplicates_only) {
+    return fixDuplicates(directory);
+  }
+
+  if (remap) {
+    return remapUIDs(directory);
+  }
+
+  if (watching) {
+    return watchDirectory();
+  }
+
+  RandomizeRun run(jobs, RunMode::RANDOMIZE);
+  printRandomizingMessage(!directory);
+
+  return runPipeline(run, directory, file_paths);
+}
+
+int main(int argc, char **argv) {
+  CLI::App app("Randomizes UIDs of godot resources.");
+
+  app.add_option("-f, --file", file_paths, "Randomize the specified file(s)")
+      ->check(CLI::ExistingFile);
+
+  app.add_flag("-r, --recursive", recursive, "Recursively randomize");
+  app.add_flag("-v, --verbose", verbose, "Verbosely randomize");
+  app.add_flag("-i, --in-place", in_place,
+               "Patch UIDs in place when they keep the file size");
+  app.add_flag("-b, --backup", backup,
+               "Copy files to <name>.bak before patching in place")
+      ->needs("--in-place");
+
+  app.add_flag("-d, --duplicates", duplicates_only,
+               "Only randomize UIDs declared by more than one file");
+  app.add_flag("-m, --remap", remap,
+               "Randomize declared UIDs and update all references to them")
+      ->excludes("--duplicates");
+  app.add_flag("-c, --cache", use_cache,
+               "Keep indexed UIDs in " + CACHE_FILE_NAME +
+                   " and only index changed files");
+  app.add_flag("-w, --watch", watching,
+               "Keep watching the directory and fix duplicate UIDs as files "
+               "change")
+      ->excludes("--file")
+      ->excludes("--remap")
+      ->excludes("--duplicates");
+  app.add_flag("--check", check,
+               "Only report duplicate and malformed UIDs, exit with an error "
+               "if any are found")
+      ->excludes("--remap")
+      ->excludes("--duplicates")
+      ->excludes("--watch")
+      ->excludes("--in-place");
+
+  app.add_flag("-u, --undo", undo,
+               "Restore the files changed by the last run from " +
+                   UNDO_DIRECTORY.string())
+      ->excludes("--file")
+      ->excludes("--remap")
+      ->excludes("--duplicates")
+      ->excludes("--watch")
+      ->excludes("--check");
+
+  app.add_flag("--io-uring", use_io_uring,
+               "Read files in batches with io_uring where the kernel allows "
+               "it");
+
+  app.add_flag("--full-scan", full_scan,
+               "When indexing or fixing duplicates, look for UIDs in all of "
+               "each .tscn and .tres file instead of stopping at the first "
+               "[sub_resource], [node] or [resource]");
+
+  app.add_flag("-g, --editor-cache", use_editor_cache,
+               "Index unchanged files from Godot's editor filesystem cache "
+               "instead of reading them")
+      ->excludes("--file");
+  app.add_flag("--uid-cache", use_godot_uid_cache,
+               "Index files older than Godot's .godot/uid_cache.bin from it "
+               "instead of reading them");
+  app.add_option("--include", include_patterns,
+                 "Also randomize files whose path or name matches the glob "
+                 "pattern(s)");
+  app.add_option("-e, --exclude", exclude_patterns,
+                 "Skip files and directories whose path or name matches the "
+                 "glob pattern(s)");
+
+  app.add_option("-j, --jobs", jobs, "Number of files to process at once")
+      ->check(CLI::PositiveNumber);
+
+  argv = app.ensure_utf8(argv);
+  CLI11_PARSE(app, argc, argv);
+
+  path_matcher.compile(include_patterns, exclude_patterns);
+
+  std::cout << "godot-uid-fixer v" << VERSION_MAJOR << "." << VERSION_MINOR
+            << "-" << RELEASE << "\n\n";
+
+  if (check) {
+    return checkUIDs(file_paths.empty());
+  }
+
+  if (undo) {
+    return undoTransaction() ? SUCCESS : FILE_OPEN_FAILED;
+  }
+
+  rollBackInterruptedRun();
 
   if (!randomize(file_paths.empty())) {
     return FILE_OPEN_FAILED;
@@ -0,0 +1,183 @@
+/*
+Counts the heap allocations made by findUIDs, rewriteFile and rewriteJob
+through a replaced operator new. Once the per thread buffers have grown,
+findUIDs must not allocate at all, and rewriteFile and rewriteJob must
+allocate the same amount for a file with one UID as for one with many, so
+nothing is allocated per UID.
+
+The per file allocations this doesn't rule out, which still keep a file from
+being handled without any allocation:
+- the FileJob made with std::make_unique for each file
+- the std::ostringstream log of the job
+- the MappedFile made by readFile
+- the path returned by parentDirectory in openTempfile, which is all that
+  rewriteFile and rewriteJob still allocate
+- the std::to_string result and the <name>.tmp path built in stageFile
+*/
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+std::atomic<size_t> allocation_count{0};
+}
+
+void *operator new(std::size_t size) {
+  allocation_count++;
+
+  if (void *pointer{std::malloc(size == 0 ? 1 : size)}) {
+    return pointer;
+  }
+
+  throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+
+void operator delete(void *pointer, std::size_t) noexcept {
+  std::free(pointer);
+}
+
+#define main godot_uid_fixer_main
+#include "../source/main.cpp"
+#undef main
+
+namespace {
+// Returns the number of allocations made by function.
+template <typename Function> size_t countAllocations(Function function) {
+  size_t before{allocation_count};
+  function();
+
+  return allocation_count - before;
+}
+
+// Writes a scene declaring one UID and referencing uid_count - 1 others.
+void writeScene(const std::filesystem::path &file_path, size_t uid_count) {
+  std::ofstream scene(file_path);
+  scene << "[gd_scene format=3 uid=\"uid://" << generateRandomUID()
+        << "\"]\n\n";
+
+  for (size_t i = 1; i < uid_count; i++) {
+    scene << "[ext_resource type=\"PackedScene\" uid=\"uid://"
+          << generateRandomUID() << "\" path=\"res://" << i
+          << ".tscn\" id=\"" << i << "\"]\n";
+  }
+}
+
+bool expect(bool condition, const std::string &message) {
+  std::cout << (condition ? "PASS: " : "FAIL: ") << message << '\n';
+
+  return condition;
+}
+} // namespace
+
+int main() {
+  char directory_template[]{"/tmp/godot-uid-fixer-test.XXXXXX"};
+
+  if (!mkdtemp(directory_template)) {
+    std::cout << "FAIL: Unable to create a temporary directory\n";
+
+    return 1;
+  }
+
+  const std::filesystem::path directory{directory_template};
+  // same length, so their paths allocate the same
+  const std::filesystem::path few_path{directory / "few.tscn"};
+  const std::filesystem::path many_path{directory / "mny.tscn"};
+  writeScene(few_path, 1);
+  writeScene(many_path, 64);
+
+  auto mapFile{[](const std::filesystem::path &file_path) {
+    auto job{std::make_unique<FileJob>()};
+    job->file_path = file_path;
+    readFile(*job);
+
+    return job;
+  }};
+
+  auto few_job{mapFile(few_path)};
+  auto many_job{mapFile(many_path)};
+  std::string_view few_buffer{few_job->mapped_file->view()};
+  std::string_view many_buffer{many_job->mapped_file->view()};
+  bool passed{true};
+
+  std::vector<UIDSpan> spans{};
+  findUIDs(many_buffer, spans);
+  spans.clear();
+
+  size_t find_allocations{countAllocations([&] {
+    spans.clear();
+    findUIDs(few_buffer, spans);
+    spans.clear();
+    findUIDs(many_buffer, spans);
+  })};
+
+  passed &= expect(spans.size() == 64, "findUIDs finds every UID");
+  passed &= expect(find_allocations == 0,
+                   "findUIDs allocates nothing once spans has grown, " +
+                       std::to_string(find_allocations) + " allocation(s)");
+
+  // writing to a stream without a buffer allocates nothing
+  std::ostream null_output{nullptr};
+  EncodedUIDs new_uids{};
+
+  auto rewrite{[&](const std::filesystem::path &file_path,
+                   std::string_view buffer) {
+    spans.clear();
+    findUIDs(buffer, spans);
+    std::vector<uint64_t> uids(spans.size(), uid_generator.nextUID());
+    new_uids.assign(uids);
+    int tempfile_descriptor{-1};
+    std::filesystem::path tempfile_path{};
+
+    size_t allocations{countAllocations([&] {
+      rewriteFile(file_path, 0644, buffer, spans, new_uids,
+                  tempfile_descriptor, tempfile_path, null_output);
+    })};
+
+    close(tempfile_descriptor);
+
+    if (!tempfile_path.empty()) {
+      std::remove(tempfile_path.c_str());
+    }
+
+    return allocations;
+  }};
+
+  rewrite(many_path, many_buffer);
+  size_t few_file_allocations{rewrite(few_path, few_buffer)};
+  size_t many_file_allocations{rewrite(many_path, many_buffer)};
+
+  passed &= expect(few_file_allocations == many_file_allocations,
+                   "rewriteFile allocates nothing per UID, " +
+                       std::to_string(many_file_allocations) +
+                       " allocation(s) per file");
+
+  auto rewriteMapped{[&](const std::filesystem::path &file_path) {
+    auto job{mapFile(file_path)};
+    size_t allocations{countAllocations([&] { rewriteJob(*job); })};
+    close(job->tempfile_descriptor);
+
+    if (!job->tempfile_path.empty()) {
+      std::remove(job->tempfile_path.c_str());
+    }
+
+    return allocations;
+  }};
+
+  rewriteMapped(many_path);
+  size_t few_job_allocations{rewriteMapped(few_path)};
+  size_t many_job_allocations{rewriteMapped(many_path)};
+
+  passed &= expect(few_job_allocations == many_job_allocations,
+                   "rewriteJob allocates nothing per UID, " +
+                       std::to_string(many_job_allocations) +
+                       " allocation(s) per file");
+
+  few_job.reset();
+  many_job.reset();
+  std::error_code error_code{};
+  std::filesystem::remove_all(directory, error_code);
+
+  return passed ? 0 : 1;
+}